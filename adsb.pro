@@ -11,7 +11,7 @@ TEMPLATE = lib
 
 DEFINES += VMPLUGINS_LIBRARY
 DEFINES += QT_DEPRECATED_WARNINGS
-LIBS += -lpthread -lusb-1.0
+LIBS += -lpthread -lusb-1.0 -lrt
 
 SOURCES += \
     libadsb.cpp \
@@ -23,7 +23,26 @@ SOURCES += \
     librtlsdr/tuner_fc2580.c \
     librtlsdr/tuner_r82xx.c \
     adsbframer.cpp \
-    modesdecoder.cpp
+    modesdecoder.cpp \
+    trackhistory.cpp \
+    kalmantracker.cpp \
+    updatecoalescer.cpp \
+    jsonwriter.cpp \
+    binaryupdatequeue.cpp \
+    mailboxpublisher.cpp \
+    aircraftsnapshot.cpp \
+    updatefilter.cpp \
+    feedserver.cpp \
+    beastoutput.cpp \
+    sbsoutput.cpp \
+    avroutput.cpp \
+    aircraftjsonwriter.cpp \
+    shmupdatering.cpp \
+    multicastpublisher.cpp \
+    websocketserver.cpp \
+    framerepair.cpp \
+    framededup.cpp \
+    gaincontrol.cpp
 
 HEADERS += \
     ConsumerProducer.h \
@@ -44,8 +63,33 @@ HEADERS += \
     librtlsdr/tuner_r82xx.h \
     adsbframer.h \
     modesdecoder.h \
+    trackhistory.h \
+    kalmantracker.h \
+    updatecoalescer.h \
+    jsonwriter.h \
+    adsbbinary.h \
+    binaryupdatequeue.h \
+    mailboxpublisher.h \
+    aircraftsnapshot.h \
+    updatefilter.h \
+    spscqueue.h \
+    pipelinequeue.h \
+    feedserver.h \
+    beastoutput.h \
+    sbsoutput.h \
+    avroutput.h \
+    aircraftjsonwriter.h \
+    adsbshm.h \
+    shmupdatering.h \
+    adsbmulticast.h \
+    multicastpublisher.h \
+    websocketserver.h \
+    framerepair.h \
+    framededup.h \
+    gaincontrol.h \
     json.hpp
 
 DISTFILES += \
     example.js \
-    example.js
+    adsb_binary.js \
+    adsbshm_reader.c
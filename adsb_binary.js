@@ -0,0 +1,67 @@
+// Decoder for the binary updates returned by ADSB.readUpdates()
+// Record layout is described in adsbbinary.h : 38 bytes, little endian.
+//
+// usage :
+//   adsb.setOutputFormat('binary');
+//   adsb.start();
+//   for( ;; ) {
+//       var updates = decodeADSBUpdates( adsb.readUpdates() );
+//       ...
+//   }
+
+var ADSB_BINARY_RECORD_SIZE = 38 ;
+var ADSB_UPDATE_TYPES = [ 'ADSBUPDATE_TYPE_NEWAIRCRAFT', 'ADSBUPDATE_TYPE_AIRCRAFTMOVE', 'ADSBUPDATE_TYPE_AIRCRAFTLOST' ];
+
+function adsbU16( b, o ) {
+    return b[o] | (b[o+1] << 8) ;
+}
+
+function adsbI16( b, o ) {
+    var v = adsbU16( b, o );
+    return v >= 0x8000 ? v - 0x10000 : v ;
+}
+
+function adsbI32( b, o ) {
+    return b[o] | (b[o+1] << 8) | (b[o+2] << 16) | (b[o+3] << 24) ;
+}
+
+function adsbU32( b, o ) {
+    return adsbI32( b, o ) >>> 0 ;
+}
+
+function decodeADSBUpdate( b, o ) {
+    var update = {
+        icao: adsbU32( b, o ),
+        update_type: b[o+4],
+        update_type_msg: ADSB_UPDATE_TYPES[b[o+4]],
+        changes: adsbU16( b, o+6 )
+    };
+    if( update.update_type == 2 ) {
+        return update ;
+    }
+    var flags = b[o+5] ;
+    update.position_valid = (flags & 1) != 0 ;
+    update.emergency = (flags >> 4) & 7 ;
+    update.lat = adsbI32( b, o+8 ) / 1e7 ;
+    update.lon = adsbI32( b, o+12 ) / 1e7 ;
+    update.altitude = adsbI32( b, o+16 );
+    update.speed = adsbU16( b, o+20 );
+    update.track = adsbU16( b, o+22 );
+    update.vert_rate = adsbI16( b, o+24 );
+    update.squawk = adsbU16( b, o+26 );
+    var flight = '' ;
+    for( var i = 0 ; i < 8 ; i++ ) {
+        flight += String.fromCharCode( b[o+28+i] );
+    }
+    update.flight = flight.trim();
+    update.rssi = adsbI16( b, o+36 ) / 10 ;
+    return update ;
+}
+
+function decodeADSBUpdates( bytes ) {
+    var result = [] ;
+    for( var o = 0 ; o + ADSB_BINARY_RECORD_SIZE <= bytes.length ; o += ADSB_BINARY_RECORD_SIZE ) {
+        result.push( decodeADSBUpdate( bytes, o ));
+    }
+    return result ;
+}
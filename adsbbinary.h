@@ -0,0 +1,46 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef ADSBBINARY_H
+#define ADSBBINARY_H
+
+/* Fixed layout binary aircraft update, an alternative to the JSON mailbox
+ * messages for high rate consumers. Plain C so it can be shared with
+ * external readers. All the fields are little endian, no padding.
+ */
+
+#include <stdint.h>
+
+#define ADSB_BINARY_VERSION 2
+
+/* flags */
+#define ADSB_BINARY_FLAG_POSITION_VALID (1<<0)
+#define ADSB_BINARY_EMERGENCY_SHIFT 4           /* bits 4-6 : emergency state */
+#define ADSB_BINARY_EMERGENCY_MASK (7<<ADSB_BINARY_EMERGENCY_SHIFT)
+
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t icao ;         /* 24 bit ICAO address */
+    uint8_t  update_type ;  /* ADSBUPDATE_TYPE_xxx */
+    uint8_t  flags ;        /* ADSB_BINARY_FLAG_xxx */
+    uint16_t changes ;      /* ADSBUPDATE_CHANGE_xxx */
+    int32_t  lat ;          /* 1e-7 degrees */
+    int32_t  lon ;          /* 1e-7 degrees */
+    int32_t  altitude ;     /* feet */
+    uint16_t speed ;        /* knots */
+    uint16_t track ;        /* degrees */
+    int16_t  vert_rate ;    /* feet per minute, negative when descending */
+    uint16_t squawk ;       /* Mode A code as 4 decimal digits, e.g. 7700 */
+    char     flight[8] ;    /* space padded, not zero terminated */
+    int16_t  rssi ;         /* tenth of dBFS, average of the recent messages */
+} ADSBBinaryUpdate ;
+#pragma pack(pop)
+
+#endif // ADSBBINARY_H
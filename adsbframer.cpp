@@ -7,61 +7,274 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
+#include <algorithm>
 
 #define FRAMER_DEBUG (0)
 
-ADSBFramer::ADSBFramer()
+ADSBFramer::ADSBFramer( int threads, int sample_rate )
 {
-    buffer = NULL ;
-    queue = new rawADSBQueue(10);
     squares_precompute();
+    precompute2400();
+    this->sample_rate = sample_rate;
+    ticks_per_sample = TIMESTAMP_CLOCK / sample_rate;
+    frame_samples = (int)((int64_t)FRAME_US * sample_rate / 1000000);
+    if (sample_rate == SAMPLE_RATE_2400) {
+        /* the slice of the last bit reads 2 samples further */
+        frame_samples += 2;}
     verbose_output = 0;
     short_output = 0;
     quality = 10;
     allowed_errors = 5;
+    sample_count = 0;
+    carry.assign(2*frame_samples, 0);
+    memset(&stats, 0, sizeof(stats));
+    noise_level = 0;
+    noise_clip = 2*MAX_MAGNITUDE;
+    preamble_threshold = 0;
+
+    if (threads < 1) {
+        threads = 1;}
+    if (threads > DEMOD_MAX_THREADS) {
+        threads = DEMOD_MAX_THREADS;}
+    chunk_count = threads;
+    chunks = new DemodChunk[chunk_count];
+    generation = 0;
+    active = 0;
+    pending = 0;
+    exiting = false;
+    for (int i=1; i<chunk_count; i++) {
+        workers.push_back(std::thread(workerThread, this, i));}
+}
+
+ADSBFramer::~ADSBFramer()
+{
+    {
+        std::lock_guard<std::mutex> l(lock);
+        exiting = true;
+    }
+    start_cond.notify_all();
+    for (std::thread& t : workers) {
+        t.join();}
+    delete[] chunks;
+    while (!queue.empty()) {
+        free(queue.front()->msg);
+        free(queue.front());
+        queue.pop_front();
+    }
 }
 
 bool ADSBFramer::hasFrames() {
-    return( !queue->isEmpty() );
+    return( !queue.empty() );
 }
 
 ADSBRawMSG *ADSBFramer::pop() {
-    ADSBRawMSG *result ;
-    queue->consume(result);
+    ADSBRawMSG *result = queue.front() ;
+    queue.pop_front();
     return( result );
 }
 
+void ADSBFramer::getStats( FramerStats *stats ) {
+    *stats = this->stats ;
+}
+
+// dBFS
+float ADSBFramer::noiseFloor() {
+    return( noise_level > 0 ? 10 * log10( noise_level / MAX_MAGNITUDE ) : 0 );
+}
+
+void ADSBFramer::workerThread(ADSBFramer *framer, int index)
+{
+    uint64_t seen = 0;
+    for (;;) {
+        std::unique_lock<std::mutex> l(framer->lock);
+        framer->start_cond.wait(l, [framer, seen]() {
+            return framer->exiting || framer->generation != seen;
+        });
+        if (framer->exiting) {
+            return;}
+        seen = framer->generation;
+        if (index >= framer->active) {
+            continue;}
+        l.unlock();
+        framer->demodulate(&framer->chunks[index]);
+        l.lock();
+        if (--framer->pending == 0) {
+            framer->done_cond.notify_one();}
+    }
+}
 
 void ADSBFramer::newDatas(char *buf, uint32_t blen ) {
-    int len;
-    buffer = (uint8_t *)buf ;
-    len = magnitute(buffer, blen);
-    manchester((uint16_t*)buffer, len);
-    messages((uint16_t*)buffer, len);
+    int len = blen / 2;
+    int64_t owned;
+    block = (const uint8_t *)buf;
+    block_start = (int64_t)sample_count;
+    block_len = len;
+
+    /* the block owns the preambles starting in [start-frame_samples,
+     * start+len-frame_samples), the ones after are not complete yet */
+    owned = block_start - frame_samples;
+    if (noise_level == 0 && len > 0) {
+        /* first block, a noise floor for the preamble threshold */
+        uint64_t sum = 0;
+        for (int i=0; i<len; i++) {
+            sum += squares[block[2*i]] + squares[block[2*i+1]];}
+        noise_level = (double)sum / len;
+        noise_clip = (uint32_t)(4 * noise_level) + 1;
+    }
+    preamble_threshold = (int32_t)(PREAMBLE_SNR * noise_level) + 1;
+    active = chunk_count;
+    if (len < chunk_count * 4 * frame_samples) {
+        active = 1;}
+    for (int i=0; i<active; i++) {
+        chunks[i].own_start = owned + (int64_t)len * i / active;
+        chunks[i].own_end = owned + (int64_t)len * (i+1) / active;
+    }
+
+    if (active > 1) {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            pending = active - 1;
+            generation++;
+        }
+        start_cond.notify_all();
+    }
+    demodulate(&chunks[0]);
+    if (active > 1) {
+        std::unique_lock<std::mutex> l(lock);
+        done_cond.wait(l, [this]() { return pending == 0; });
+    }
+
+    /* chunks are in sample order, and so are their frames. A frame is
+     * owned by one chunk only, the check is a safety net. */
+    uint64_t last = 0;
+    bool first = true;
+    uint64_t block_noise = 0;
+    for (int i=0; i<active; i++) {
+        block_noise += chunks[i].stats.noise_sum;
+        stats.samples += chunks[i].stats.samples;
+        stats.saturated += chunks[i].stats.saturated;
+        stats.noise_sum += chunks[i].stats.noise_sum;
+        stats.preambles += chunks[i].stats.preambles;
+        stats.frames += chunks[i].stats.frames;
+        for (ADSBRawMSG *msg : chunks[i].frames) {
+            if (!first && msg->timestamp <= last) {
+                free(msg->msg);
+                free(msg);
+                continue;
+            }
+            first = false;
+            last = msg->timestamp;
+            queue.push_back(msg);
+        }
+        chunks[i].frames.clear();
+    }
+
+    /* rolling noise floor, the first block sets it */
+    if (len > 0) {
+        double level = (double)block_noise / len;
+        noise_level += (level - noise_level) / 8;
+        noise_clip = (uint32_t)(4 * noise_level) + 1;
+    }
+
+    /* keep the end of the block for the next one */
+    int64_t keep = 2*frame_samples;
+    if (len >= keep) {
+        for (int i=0; i<keep; i++) {
+            const uint8_t *iq = block + 2*(len - keep + i);
+            carry[i] = squares[iq[0]] + squares[iq[1]];
+        }
+    } else {
+        carry.erase(carry.begin(), carry.begin() + len);
+        for (int i=0; i<len; i++) {
+            carry.push_back(squares[block[2*i]] + squares[block[2*i+1]]);}
+    }
+    sample_count += len;
+}
+
+void ADSBFramer::demodulate(DemodChunk *c)
+{
+    c->frames.clear();
+    c->preamble_pos.clear();
+    c->preamble_level.clear();
+    c->preamble_next = 0;
+    memset(&c->stats, 0, sizeof(c->stats));
+    if (c->own_end <= c->own_start) {
+        return;}
+    int64_t from = c->own_start - frame_samples;
+    int64_t to = c->own_end + frame_samples;
+    if (from < block_start - 2*frame_samples) {
+        from = block_start - 2*frame_samples;}
+    if (to > block_start + block_len) {
+        to = block_start + block_len;}
+    magnitute(c, from, to);
+    signalStats(c);
+    if (sample_rate == SAMPLE_RATE_2400) {
+        demodulate2400(c);
+    } else {
+        manchester(c);
+        messages(c);
+    }
+    for (size_t i=0; i<c->preamble_pos.size(); i++) {
+        int64_t pos = c->base + c->preamble_pos[i];
+        if (pos >= c->own_start && pos < c->own_end) {
+            c->stats.preambles++;}
+    }
+    c->stats.frames = c->frames.size();
+}
+
+void ADSBFramer::signalStats(DemodChunk *c)
+/* the block samples shifted by frame_samples from the owned preambles, so
+ * each sample is counted by one chunk */
+{
+    int64_t from = c->own_start + frame_samples;
+    int64_t to = c->own_end + frame_samples;
+    uint64_t saturated = 0, sum = 0;
+    uint32_t clip = noise_clip;
+    if (from < block_start) {
+        from = block_start;}
+    if (to > block_start + block_len) {
+        to = block_start + block_len;}
+    for (int64_t i=from; i<to; i++) {
+        const uint8_t *iq = block + 2*(i - block_start);
+        saturated += (iq[0] == 0 || iq[0] == 255 || iq[1] == 0 || iq[1] == 255);
+        uint32_t m = c->mag[i - c->base];
+        sum += m < clip ? m : clip;
+    }
+    c->stats.samples = to > from ? to - from : 0;
+    c->stats.saturated = saturated;
+    c->stats.noise_sum = sum;
 }
 
-void ADSBFramer::manchester(uint16_t *buf, int len)
+void ADSBFramer::manchester(DemodChunk *c)
 /* overwrites magnitude buffer with valid bits (BADSAMPLE on errors) */
 {
+    uint16_t *buf = c->mag.data();
+    int len = (int)c->mag.size();
     /* a and b hold old values to verify local manchester */
     uint16_t a=0, b=0;
     uint16_t bit;
     int i, i2, start, errors;
     int maximum_i = len - 1;        // len-1 since we look at i and i+1
-    // todo, allow wrap across buffers
+    size_t next = 0;
+    /* the candidates come from the samples before they are overwritten,
+     * the search only looks at the ones after the last frame, untouched */
+    findPreambles(c);
     i = 0;
     while (i < maximum_i) {
         /* find preamble */
-        for ( ; i < (len - preamble_len); i++) {
-            if (!preamble(buf, i)) {
-                continue;}
-            a = buf[i];
-            b = buf[i+1];
-            for (i2=0; i2<preamble_len; i2++) {
-                buf[i+i2] = MESSAGEGO;}
-            i += preamble_len;
-            break;
-        }
+        while (next < c->candidates.size() && c->candidates[next] < i) {
+            next++;}
+        if (next == c->candidates.size()) {
+            break;}
+        i = c->candidates[next++];
+        a = buf[i];
+        b = buf[i+1];
+        c->preamble_pos.push_back(i);
+        c->preamble_level.push_back((uint16_t)(((int)buf[i] + buf[i+2] + buf[i+7] + buf[i+9]) / 4));
+        for (i2=0; i2<preamble_len; i2++) {
+            buf[i+i2] = MESSAGEGO;}
+        i += preamble_len;
         i2 = start = i;
         errors = 0;
         /* mark bits until encoding breaks */
@@ -129,40 +342,85 @@ uint16_t ADSBFramer::single_manchester(uint16_t a, uint16_t b, uint16_t c, uint1
     return BADSAMPLE;
 }
 
-int ADSBFramer::preamble(uint16_t *buf, int i)
-/* returns 0/1 for preamble at index i */
-{
-    int i2;
-    uint16_t low  = 0;
-    uint16_t high = 65535;
-    for (i2=0; i2<preamble_len; i2++) {
-        switch (i2) {
-            case 0:
-            case 2:
-            case 7:
-            case 9:
-                //high = min16(high, buf[i+i2]);
-                high = buf[i+i2];
-                break;
-            default:
-                //low  = max16(low,  buf[i+i2]);
-                low = buf[i+i2];
-                break;
+/* 16 consecutive offsets scored at once, GCC vector extensions become
+ * SSE2 or NEON code without any build flag */
+typedef int32_t v16si __attribute__((vector_size(64)));
+typedef uint16_t v16hu __attribute__((vector_size(32)));
+
+static inline void load16(v16si &v, const uint16_t *p)
+{
+    v16hu h;
+    memcpy(&h, p, sizeof(h));
+    v = __builtin_convertvector(h, v16si);
+}
+
+static inline void addCandidate(std::vector<int> &out, int pos, int32_t score, int32_t &last)
+/* a run of offsets passing is one preamble, keep its best one */
+{
+    if (!out.empty() && out.back() == pos - 1) {
+        if (score > last) {
+            out.back() = pos;
+            last = score;}
+        return;
+    }
+    out.push_back(pos);
+    last = score;
+}
+
+void ADSBFramer::findPreambles(DemodChunk *c)
+/* correlates the magnitudes with the preamble pulses (samples 0, 2, 7, 9),
+ * the offsets whose score clears the noise floor are the candidates */
+{
+    const uint16_t *buf = c->mag.data();
+    int len = (int)c->mag.size();
+    int32_t threshold = preamble_threshold;
+    int32_t last = 0;
+    int i = 0, k;
+
+    c->candidates.clear();
+    for ( ; i + 16 + preamble_len <= len; i+=16) {
+        v16si b[preamble_len];
+        for (k=0; k<preamble_len; k++) {
+            load16(b[k], buf + i + k);}
+        v16si pulses = b[0] + b[2] + b[7] + b[9];
+        v16si gaps = b[1] + b[3] + b[4] + b[5] + b[6] + b[8];
+        for (k=10; k<preamble_len; k++) {
+            gaps += b[k];}
+        v16si lo = b[0] < b[2] ? b[0] : b[2];
+        lo = lo < b[7] ? lo : b[7];
+        lo = lo < b[9] ? lo : b[9];
+        /* the 4 pulses well above the 12 gaps, each one twice the mean gap */
+        v16si score = 3*pulses - gaps;
+        v16si pass = (score > threshold) & (6*lo > gaps);
+        for (k=0; k<16; k++) {
+            if (pass[k]) {
+                addCandidate(c->candidates, i + k, score[k], last);}
         }
-        if (high <= low) {
-            return 0;}
     }
-    return 1;
+    for ( ; i + preamble_len <= len; i++) {
+        const uint16_t *m = buf + i;
+        int32_t pulses = m[0] + m[2] + m[7] + m[9];
+        int32_t gaps = -pulses;
+        int32_t lo = std::min(std::min(m[0], m[2]), std::min(m[7], m[9]));
+        for (k=0; k<preamble_len; k++) {
+            gaps += m[k];}
+        int32_t score = 3*pulses - gaps;
+        if (score > threshold && 6*lo > gaps) {
+            addCandidate(c->candidates, i, score, last);}
+    }
 }
 
-void ADSBFramer::messages(uint16_t *buf, int len)
+void ADSBFramer::messages(DemodChunk *c)
 {
+    uint16_t *buf = c->mag.data();
+    int len = (int)c->mag.size();
+    int *adsb_frame = c->adsb_frame;
     int i ;
-    int data_i, index, shift, frame_len;
-    // todo, allow wrap across buffers
+    int data_i, index, shift, frame_len, start;
     for (i=0; i<len; i++) {
         if (buf[i] > 1) {
             continue;}
+        start = i;
         frame_len = long_frame;
         data_i = 0;
         for (index=0; index<14; index++) {
@@ -184,20 +442,28 @@ void ADSBFramer::messages(uint16_t *buf, int len)
         }
         if (data_i < (frame_len-1)) {
             continue;}
-        makeFrame(adsb_frame, frame_len);
+        makeFrame(c, frame_len, start - preamble_len, 0);
 
     }
 }
 
 
-void ADSBFramer::makeFrame(int *frame, int len)
+void ADSBFramer::makeFrame(DemodChunk *c, int len, int pos, int ticks)
+/* pos : preamble sample in the chunk, ticks : timestamp clock ticks from
+ * the start of that sample to the start of the preamble */
 {
     int i, df;
+    int *frame = c->adsb_frame;
+    uint16_t level = 0;
     unsigned char *buffer ;
 
     if ( len < short_frame) { //<=
         return;
     }
+    /* seen by the neighbour chunk too, which owns it */
+    if (c->base + pos < c->own_start || c->base + pos >= c->own_end) {
+        return;
+    }
 
     df = (frame[0] >> 3) & 0x1f;
     if (quality == 0 && !(df==11 || df==17 || df==18 || df==19)) {
@@ -210,27 +476,67 @@ void ADSBFramer::makeFrame(int *frame, int len)
     for (i=0; i<((len+7)/8); i++) {
         buffer[i] = (char)frame[i];
     }
+    /* bits follow their preamble, both lists are in sample order */
+    while (c->preamble_next < c->preamble_pos.size() && c->preamble_pos[c->preamble_next] < pos) {
+        c->preamble_next++;
+    }
+    if (c->preamble_next < c->preamble_pos.size() && c->preamble_pos[c->preamble_next] == pos) {
+        level = c->preamble_level[c->preamble_next];
+    }
     ADSBRawMSG* msg = (ADSBRawMSG *)malloc( sizeof(ADSBRawMSG));
     msg->len = len+1 ;
     msg->msg = buffer ;
-    queue->add( msg );
+    msg->timestamp = (uint64_t)(c->base + pos) * ticks_per_sample + ticks ;
+    msg->signal = (uint8_t)lround(sqrt((double)level / MAX_MAGNITUDE) * 255);
+    msg->receiver = 0 ;
+
+    /* mean power of the high half of each bit and the margin between the
+     * two halves, read from the samples as the chunk magnitudes now hold bits */
+    uint64_t sum = 0;
+    int64_t tick = (c->base + pos) * ticks_per_sample + ticks + PREAMBLE_TICKS + BIT_TICKS/4;
+    memset(msg->confidence, 0xff, sizeof(msg->confidence));
+    for (i=0; i<len && i<long_frame; i++, tick += BIT_TICKS) {
+        int bit = (buffer[i/8] >> (7 - i%8)) & 1;
+        int first = sampleMagnitude(tick / ticks_per_sample);
+        int second = sampleMagnitude((tick + BIT_TICKS/2) / ticks_per_sample);
+        int high = bit ? first : second;
+        int low = bit ? second : first;
+        sum += high;
+        /* a bit the samples disagree with was guessed */
+        msg->confidence[i] = high > low ? (uint8_t)((high - low) * 255 / (high + low)) : 0;
+    }
+    double power = (double)sum / len;
+    msg->rssi = (float)(10 * log10((power > 1 ? power : 1) / MAX_MAGNITUDE));
+    c->frames.push_back( msg );
 }
 
-int ADSBFramer::magnitute(uint8_t *buf, int len)
-/* takes i/q, changes buf in place (16 bit), returns new len (16 bit) */
+void ADSBFramer::magnitute(DemodChunk *c, int64_t from, int64_t to)
+/* magnitudes of the samples [from, to), the ones before the block come
+ * from the previous block */
 {
-    int i;
+    int64_t i;
+    int64_t kept = block_start - 2*frame_samples;
     uint16_t *m;
-    //float snr = 0 ;
 
-    for (i=0; i<len; i+=2) {
-        m = (uint16_t*)(&buf[i]);
-        *m = squares[buf[i]] + squares[buf[i+1]];
-        //snr += (float)*m ;
+    c->base = from;
+    c->mag.resize(to - from);
+    m = c->mag.data();
+    for (i=from; i<to && i<block_start; i++) {
+        *m++ = carry[i - kept];
+    }
+    for ( ; i<to; i++) {
+        const uint8_t *iq = block + 2*(i - block_start);
+        *m++ = squares[iq[0]] + squares[iq[1]];
     }
-    //snr /= len ;
+}
 
-    return len/2;
+uint16_t ADSBFramer::sampleMagnitude(int64_t n)
+/* magnitude of sample n, in the current block or kept from the previous */
+{
+    if (n < block_start) {
+        return carry[n - (block_start - 2*frame_samples)];}
+    const uint8_t *iq = block + 2*(n - block_start);
+    return squares[iq[0]] + squares[iq[1]];
 }
 
 void ADSBFramer::squares_precompute(void)
@@ -251,3 +557,131 @@ int ADSBFramer::abs8(int x)
         return x - 128;}
     return 128 - x;
 }
+
+/* 2.4 MSPS demodulator
+ *
+ * At 2.4 MSPS a bit lasts 2.4 samples, half a bit 1.2. Both are whole
+ * numbers of ticks of the 12 MHz timestamp clock : a sample is 5 ticks, a
+ * half bit 6, so a bit or a pulse starts on one of 5 phases of a sample.
+ * The samples are boxes of 5 ticks, each one weighs in a half bit or a
+ * pulse for the ticks they share. */
+
+#define SAMPLE_TICKS	5
+
+void ADSBFramer::precompute2400(void)
+{
+    /* preamble pulses at 0, 1, 3.5 and 4.5 us, 0.5 us long */
+    static const int pulses[4] = { 0, 12, 42, 54 };
+    int p, t, k, n;
+    memset(slice_weights, 0, sizeof(slice_weights));
+    for (p=0; p<PHASES_2400; p++) {
+        /* first half bit counts for 1, the second one for 0 */
+        for (t=0; t<BIT_TICKS; t++) {
+            n = (p + t) / SAMPLE_TICKS;
+            slice_weights[p][n] += t < BIT_TICKS/2 ? 1 : -1;
+        }
+        /* a pulse is 6 ticks, over 2 samples */
+        for (k=0; k<4; k++) {
+            t = p + pulses[k];
+            pulse_sample[p][k] = t / SAMPLE_TICKS;
+            pulse_share[p][k] = (pulse_sample[p][k] + 1) * SAMPLE_TICKS - t;
+        }
+    }
+}
+
+int ADSBFramer::decode2400(const uint16_t *m, int phase, int len, int *frame, int *margin)
+/* bits of a frame whose preamble starts on tick phase of m[0], returns the
+ * number of bits whose halves differ by less than margin, the mean
+ * difference in margin */
+{
+    int i, t, n, f, weak = 0;
+    int64_t sum = 0;
+    for (i=0; i<14; i++) {
+        frame[i] = 0;}
+    for (i=0; i<len; i++) {
+        t = phase + PREAMBLE_TICKS + i * BIT_TICKS;
+        n = t / SAMPLE_TICKS;
+        f = t % SAMPLE_TICKS;
+        const int *w = slice_weights[f];
+        int v = w[0]*m[n] + w[1]*m[n+1] + w[2]*m[n+2] + w[3]*m[n+3];
+        if (v > 0) {
+            frame[i/8] |= 1 << (7 - i%8);}
+        if (abs(v) < *margin) {
+            weak++;}
+        sum += abs(v);
+    }
+    *margin = (int)(sum / len);
+    return weak;
+}
+
+void ADSBFramer::demodulate2400(DemodChunk *c)
+/* the preamble may start on any tick of 3 samples, the hypothesis whose
+ * bits are the most clear cut wins */
+{
+    uint16_t *m = c->mag.data();
+    int len = (int)c->mag.size();
+    int best_frame[14];
+    int j, o, p, k, n;
+    for (j=0; j < len - frame_samples - 2; j++) {
+        uint16_t *s = m + j;
+        /* cheap test first : the samples covered by the pulses whatever
+         * the phase are above the ones always in the gaps */
+        int low = (s[5] + s[6] + s[7] + s[13] + s[14] + s[15] + s[16] + s[17] + s[18]) * 2 / 9;
+        if (s[0] + s[1] <= low || s[2] + s[3] <= low ||
+            s[8] + s[9] <= low || s[11] + s[12] <= low) {
+            continue;}
+
+        int best_offset = -1, best_phase = 0, best_margin = 0, best_len = 0, best_level = 0;
+        for (o=0; o<3; o++) {
+            uint16_t *h = s + o;
+            int64_t inner = 0;
+            for (n=1; n<19; n++) {
+                inner += h[n];}
+            for (p=0; p<PHASES_2400; p++) {
+                /* each pulse 3 dB above the mean of the gaps */
+                int64_t window = (SAMPLE_TICKS - p) * h[0] + SAMPLE_TICKS * inner + (p + 1) * h[19];
+                int64_t pulse[4], high = 0;
+                for (k=0; k<4; k++) {
+                    n = pulse_sample[p][k];
+                    pulse[k] = pulse_share[p][k] * h[n] + (BIT_TICKS/2 - pulse_share[p][k]) * h[n+1];
+                    high += pulse[k];
+                }
+                int64_t gap = window - high;    /* 72 ticks, a pulse is 6 */
+                for (k=0; k<4; k++) {
+                    if (pulse[k] * 12 <= gap * 2) {
+                        break;}
+                }
+                if (k < 4) {
+                    continue;}
+                /* a clean bit differs by 6 ticks of pulse minus gap level */
+                int level = (int)(high / 24 - gap / 72);
+                int margin = level * 6 / 4;
+                int weak = decode2400(h, p, short_frame, c->adsb_frame, &margin);
+                if (c->adsb_frame[0] == 0) {
+                    continue;}
+                int frame_len = (c->adsb_frame[0] & 0x80) ? long_frame : short_frame;
+                if (frame_len == long_frame) {
+                    margin = level * 6 / 4;
+                    weak = decode2400(h, p, long_frame, c->adsb_frame, &margin);
+                }
+                if (weak > allowed_errors || margin <= best_margin) {
+                    continue;}
+                best_offset = o;
+                best_phase = p;
+                best_margin = margin;
+                best_len = frame_len;
+                best_level = (int)(high / 24);
+                memcpy(best_frame, c->adsb_frame, sizeof(best_frame));
+            }
+        }
+        if (best_offset < 0) {
+            continue;}
+        j += best_offset;
+        c->preamble_pos.push_back(j);
+        c->preamble_level.push_back((uint16_t)best_level);
+        memcpy(c->adsb_frame, best_frame, sizeof(best_frame));
+        makeFrame(c, best_len, j, best_phase);
+        /* next preamble after this frame */
+        j += (best_phase + PREAMBLE_TICKS + best_len * BIT_TICKS) / SAMPLE_TICKS - 1;
+    }
+}
@@ -1,16 +1,26 @@
 #ifndef ADSBFRAMER_H
 #define ADSBFRAMER_H
 
-/* ADSBFramer : decode ADS-B Binary frames from 2 MSPS raw I/Q from receiver
+/* ADSBFramer : decode ADS-B Binary frames from raw I/Q from receiver
  * Sylvain AZARIAN - 2013
  * Most of the code comes from opensource
  * rtl_adsb from oscmocom
  *
+ * The sample rate is chosen at construction :
+ *  - SAMPLE_RATE (2 MSPS), two samples per bit, correlation preamble
+ *    detector then manchester decoding of the sample pairs
+ *  - SAMPLE_RATE_2400 (2.4 MSPS), 2.4 samples per bit, each frame is
+ *    decoded for PHASES_2400 bit start hypotheses per sample and the one
+ *    with the best margin is kept
 */
 
 
 #include <stdint.h>
-#include "ConsumerProducer.h"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #define DEFAULT_ASYNC_BUF_NUMBER	12
 #define DEFAULT_BUF_LENGTH		(16 * 16384)
@@ -24,40 +34,134 @@
 #define long_frame		112
 #define short_frame		56
 
+#define SAMPLE_RATE		2000000
+#define SAMPLE_RATE_2400	2400000	/* fractional bit demodulator */
+#define TIMESTAMP_CLOCK		12000000	/* frame timestamps use a 12 MHz clock */
+#define PREAMBLE_TICKS		96	/* 8 us */
+#define BIT_TICKS		12
+#define MAX_MAGNITUDE		32768	/* squares[] of a full scale I/Q sample */
+#define ADSB_MAX_RECEIVERS	4	/* devices merged into one decoder */
+
 typedef struct {
     unsigned char *msg ;
     int len ;
+    uint64_t timestamp ;    /* 12 MHz ticks at the start of the preamble */
+    uint8_t signal ;        /* preamble amplitude, 255 = full scale */
+    uint8_t receiver ;      /* device the frame comes from, 0 for the first,
+                             * each device has its own timestamp clock */
+    float rssi ;            /* dBFS, mean power of the bits */
+    uint8_t confidence[long_frame] ;    /* per bit, 0 for a guess, 255 when one
+                                         * half of the bit holds all the power */
 } ADSBRawMSG ;
 
-typedef ConsumerProducerQueue<ADSBRawMSG *> rawADSBQueue ;
+#define FRAME_US	(8 + long_frame)	/* longest frame, preamble included */
+#define PHASES_2400	5		/* bit start hypotheses per sample at 2.4 MSPS */
+#define PREAMBLE_SNR	32		/* preamble score threshold, times the noise floor */
+#define DEMOD_MAX_THREADS	16
+
+/* Signal statistics, totals since the framer was created */
+typedef struct {
+    uint64_t samples ;
+    uint64_t saturated ;        /* I or Q at the limits of the ADC */
+    uint64_t noise_sum ;        /* of all the samples, clipped to 4 times the
+                                 * noise floor so the frames barely count */
+    uint64_t preambles ;
+    uint64_t frames ;
+} FramerStats ;
+
+/* Demodulation state of one chunk of a block. The chunk owns the frames
+ * whose preamble starts in [own_start, own_end), absolute sample numbers,
+ * and scans frame_samples more on both sides so the frames crossing its
+ * edges are seen whole. */
+typedef struct {
+    int64_t own_start ;
+    int64_t own_end ;
+    int64_t base ;                      /* sample number of mag[0] */
+    std::vector<uint16_t> mag ;
+    std::vector<int> preamble_pos ;
+    std::vector<uint16_t> preamble_level ;
+    std::vector<int> candidates ;       /* offsets that may start a preamble */
+    size_t preamble_next ;
+    int adsb_frame[14] ;
+    std::vector<ADSBRawMSG *> frames ;  /* found, in sample order */
+    FramerStats stats ;                 /* of the owned samples, this block */
+} DemodChunk ;
 
 class ADSBFramer
 {
 
 public:
-    ADSBFramer();
+    ADSBFramer( int threads = 1, int sample_rate = SAMPLE_RATE );
+    ~ADSBFramer();
     void newDatas(char *buf, uint32_t blen ) ;
     bool hasFrames();
     ADSBRawMSG *pop();
+    void getStats( FramerStats *stats );
+    float noiseFloor();
 
 private:
-    uint8_t *buffer;
     uint16_t squares[256];
-    int adsb_frame[14];
     int verbose_output ;
     int short_output  ;
     int quality  ;
     int allowed_errors ;
-    rawADSBQueue *queue ;
+    std::deque<ADSBRawMSG *> queue ;
+    FramerStats stats ;
+    /* mean power of the samples without the frames, averaged over the
+     * blocks, and the clip level it gives to the next block */
+    double noise_level ;
+    uint32_t noise_clip ;
+    int32_t preamble_threshold ;
+
+    int sample_rate ;
+    int frame_samples ;                 /* FRAME_US at sample_rate */
+    int ticks_per_sample ;
+
+    /* 2.4 MSPS : a sample lasts 5 ticks of the timestamp clock and a bit
+     * 12, so a bit can start on 5 phases of a sample. Per phase, the weight
+     * of each sample in the first half bit minus the second one, and the
+     * first sample of each preamble pulse with its share of the pulse,
+     * counted in ticks. */
+    int slice_weights[PHASES_2400][4] ;
+    int pulse_sample[PHASES_2400][4] ;
+    int pulse_share[PHASES_2400][4] ;
+
+    /* Samples received before the current block. The magnitudes of the
+     * last 2*frame_samples ones are kept, so frames crossing the end of a
+     * block are found in the next one. */
+    uint64_t sample_count ;
+    std::vector<uint16_t> carry ;
+
+    /* Chunk 0 runs in the calling thread, the others in the workers */
+    int chunk_count ;
+    DemodChunk *chunks ;
+    std::vector<std::thread> workers ;
+    std::mutex lock ;
+    std::condition_variable start_cond ;
+    std::condition_variable done_cond ;
+    uint64_t generation ;
+    int active ;                        /* chunks of the current block */
+    int pending ;
+    bool exiting ;
+    const uint8_t *block ;
+    int64_t block_start ;
+    int block_len ;
 
-    int magnitute(uint8_t *buf, int len) ;
-    void manchester(uint16_t *buf, int len);
+    static void workerThread( ADSBFramer *framer, int index );
+    void demodulate( DemodChunk *c );
+    void magnitute( DemodChunk *c, int64_t from, int64_t to );
+    void signalStats( DemodChunk *c );
+    uint16_t sampleMagnitude( int64_t n );
+    void manchester(DemodChunk *c);
     uint16_t single_manchester(uint16_t a, uint16_t b, uint16_t c, uint16_t d);
     void squares_precompute(void) ;
     int abs8(int x) ;
-    int preamble(uint16_t *buf, int i);
-    void messages(uint16_t *buf, int len);
-    void makeFrame(int *frame, int len);
+    void findPreambles(DemodChunk *c);
+    void messages(DemodChunk *c);
+    void precompute2400(void);
+    void demodulate2400(DemodChunk *c);
+    int decode2400(const uint16_t *m, int phase, int len, int *frame, int *margin);
+    void makeFrame(DemodChunk *c, int len, int pos, int ticks);
 };
 
 #endif // ADSBFRAMER_H
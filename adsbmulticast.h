@@ -0,0 +1,55 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef ADSBMULTICAST_H
+#define ADSBMULTICAST_H
+
+/* Layout of the UDP multicast datagrams. Plain C so it can be shared with
+ * external receivers. All the fields are little endian, no padding.
+ *
+ * Each datagram is a header followed by 'count' records of one type :
+ *  - ADSB_MCAST_FRAMES : ADSBMulticastFrame, followed by its 'len' message
+ *    bytes, for every frame with a valid CRC
+ *  - ADSB_MCAST_UPDATES : ADSBBinaryUpdate records, see adsbbinary.h
+ *
+ * 'seq' counts the datagrams of a publisher, whatever their type : a gap
+ * means datagrams were lost, on the network or because the sender thread
+ * fell behind.
+ */
+
+#include <stdint.h>
+#include "adsbbinary.h"
+
+#define ADSB_MCAST_MAGIC 0x4d534441     /* "ADSM" */
+#define ADSB_MCAST_VERSION 3
+#define ADSB_MCAST_MAX_PAYLOAD 1472     /* 1500 bytes Ethernet MTU - IP and UDP headers */
+
+#define ADSB_MCAST_FRAMES 1
+#define ADSB_MCAST_UPDATES 2
+
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t magic ;
+    uint8_t  version ;
+    uint8_t  type ;         /* ADSB_MCAST_xxx */
+    uint16_t count ;        /* records in the datagram */
+    uint32_t seq ;
+    uint32_t reserved ;
+} ADSBMulticastHeader ;
+
+typedef struct {
+    uint64_t timestamp ;    /* 12 MHz clock */
+    uint8_t  signal ;       /* 255 = full scale */
+    uint8_t  receiver ;     /* device of the publisher that heard it */
+    uint8_t  len ;          /* message bytes following, 7 or 14 */
+} ADSBMulticastFrame ;
+#pragma pack(pop)
+
+#endif // ADSBMULTICAST_H
@@ -10,10 +10,18 @@
 
 #include <math.h>
 #include <string.h>
+#include <pthread.h>
+#include <vector>
 #include "vmtoolbox.h"
 #include "adsbplugin.h"
 #include "adsbframer.h"
 #include "modesdecoder.h"
+#include "updatecoalescer.h"
+#include "mailboxpublisher.h"
+#include "aircraftsnapshot.h"
+#include "beastoutput.h"
+#include "sbsoutput.h"
+#include "avroutput.h"
 #include "json.hpp"
 
 
@@ -22,6 +30,7 @@ using json = nlohmann::json;
 const char JSTypeNameStr[] = "ADSB" ;
 const char BOXNAME[] = "ADSBMESSAGES" ;
 
+
 const char* ADSBPlugin::Name() {
     return( (const char*) JSTypeNameStr );
 }
@@ -42,11 +51,223 @@ void ADSBPlugin::deleteInstance(IJSClass *instance) {
     delete instance ;
 }
 
+// the class registered with the VM is never init(), it owns nothing
+ADSBPlugin::~ADSBPlugin() {
+    if( json_writer == nullptr )
+        return ;
+    stop();
+    // reverse order of init(), the writers read the decoder
+    delete json_writer ;
+    delete params.websocket ;
+    delete params.updates ;
+    for( int i = ADSB_MAX_RECEIVERS - 1 ; i >= 0 ; i-- ) {
+        delete params.receivers[i].frames ;
+        delete params.receivers[i].queue ;
+    }
+    delete params.multicast ;
+    delete params.shm ;
+    delete params.avr ;
+    delete params.sbs ;
+    delete params.beast ;
+    delete params.new_filter.exchange( nullptr );
+    delete params.filter ;
+    delete params.binary ;
+    delete params.decoder ;
+}
+
 void ADSBPlugin::init() {
     adsb = nullptr ;
+    params.stop = false ;
+    // the decoder outlives the thread so its state can be configured
+    // before start() and still be queried once stopped
+    params.decoder = new ModeSDecoder();
+    params.update_interval = DEFAULT_UPDATE_INTERVAL ;
+    params.output_format = ADSB_OUTPUT_JSON ;
+    params.binary = nullptr ;
+    params.batch_updates = 1 ;
+    params.batch_latency = 0 ;
+    params.filter = new UpdateFilter();
+    params.new_filter = nullptr ;
+    params.beast = new TCPFeedServer();
+    params.sbs = new TCPFeedServer();
+    params.avr = new TCPFeedServer();
+    params.avr_format = AVR_FORMAT_PLAIN ;
+    params.shm = new ShmUpdateRing();
+    params.multicast = new MulticastPublisher();
+    for( int i = 0 ; i < ADSB_MAX_RECEIVERS ; i++ ) {
+        ADSBReceiver *rx = &params.receivers[i] ;
+        rx->serial[0] = 0 ;
+        rx->device = nullptr ;
+        rx->queue = new TrtlQueue( PIPELINE_BLOCKS );
+        rx->frames = new PipelineQueue<ADSBRawMSG *>( PIPELINE_FRAMES, &params.frames_signal );
+        rx->streaming = false ;
+        rx->frame_count = 0 ;
+        rx->signal_sum = 0 ;
+        rx->duplicates = 0 ;
+        rx->valid_frames = 0 ;
+        rx->gain = AUTO_GAIN ;
+        rx->noise_floor = 0 ;
+    }
+    params.receiver_count = 0 ;
+    params.updates = new PipelineQueue<PublishItem>( PIPELINE_UPDATES );
+    for( int i = 0 ; i < PIPELINE_STAGES ; i++ ) {
+        params.affinity[i] = -1 ;
+    }
+    params.demod_threads = 1 ;
+    params.sample_rate = SAMPLE_RATE ;
+    params.gain_mode = GAIN_AGC ;
+    params.gain = 0 ;
+    params.websocket = new WebSocketServer( params.decoder->snapshot() );
+    json_writer = new AircraftJSONWriter( params.decoder );
     box = vmtools->getMBox( (char *)BOXNAME ) ;
 }
 
+void ADSBPlugin::setUpdateInterval( int ms ) {
+    params.update_interval = ms ;
+}
+
+bool ADSBPlugin::setOutputFormat( const char *format ) {
+    if( strcmp( format, "json" ) == 0 ) {
+        params.output_format = ADSB_OUTPUT_JSON ;
+        return( true );
+    }
+    if( strcmp( format, "binary" ) == 0 ) {
+        if( params.binary == nullptr )
+            params.binary = new BinaryUpdateQueue();
+        params.output_format = ADSB_OUTPUT_BINARY ;
+        return( true );
+    }
+    if( strcmp( format, "avr" ) == 0 ) {
+        params.output_format = ADSB_OUTPUT_AVR ;
+        return( true );
+    }
+    return( false );
+}
+
+bool ADSBPlugin::setAVRFormat( const char *format ) {
+    int f = avrFormatByName( format );
+    if( f < 0 )
+        return( false );
+    params.avr_format = f ;
+    return( true );
+}
+
+void ADSBPlugin::setBatching( int max_updates, int max_latency ) {
+    params.batch_updates = max_updates ;
+    params.batch_latency = max_latency ;
+}
+
+// the compiled filter is handed to decode_thread, which swaps it in before
+// its next batch of frames, so it can be changed while running
+bool ADSBPlugin::setFilter( const char *spec ) {
+    UpdateFilter *filter = new UpdateFilter();
+    if( !filter->compile( spec )) {
+        delete filter ;
+        return( false );
+    }
+    delete params.new_filter.exchange( filter );
+    return( true );
+}
+
+TCPFeedServer *ADSBPlugin::beastServer() {
+    return( params.beast );
+}
+
+TCPFeedServer *ADSBPlugin::sbsServer() {
+    return( params.sbs );
+}
+
+TCPFeedServer *ADSBPlugin::avrServer() {
+    return( params.avr );
+}
+
+AircraftJSONWriter *ADSBPlugin::jsonWriter() {
+    return( json_writer );
+}
+
+ShmUpdateRing *ADSBPlugin::sharedMemory() {
+    return( params.shm );
+}
+
+MulticastPublisher *ADSBPlugin::multicast() {
+    return( params.multicast );
+}
+
+WebSocketServer *ADSBPlugin::websocketServer() {
+    return( params.websocket );
+}
+
+void ADSBPlugin::getPipelineStats( PipelineStats *stats ) {
+    stats->dropped_blocks = 0 ;
+    stats->dropped_frames = 0 ;
+    for( int i = 0 ; i < ADSB_MAX_RECEIVERS ; i++ ) {
+        stats->dropped_blocks += params.receivers[i].queue->droppedItems();
+        stats->dropped_frames += params.receivers[i].frames->droppedItems();
+    }
+    stats->dropped_updates = params.updates->droppedItems();
+}
+
+// receivers of the last start(), stats has room for ADSB_MAX_RECEIVERS
+int ADSBPlugin::getReceiverStats( ReceiverStats *stats ) {
+    for( int i = 0 ; i < params.receiver_count ; i++ ) {
+        ADSBReceiver *rx = &params.receivers[i] ;
+        strcpy( stats[i].serial, rx->serial );
+        stats[i].frames = rx->frame_count ;
+        stats[i].duplicates = rx->duplicates ;
+        stats[i].signal = stats[i].frames > 0 ? (int)(rx->signal_sum / stats[i].frames) : 0 ;
+        stats[i].gain = rx->gain ;
+        stats[i].noise_floor = rx->noise_floor ;
+    }
+    return( params.receiver_count );
+}
+
+bool ADSBPlugin::setDemodThreads( int threads ) {
+    if( (threads < 1) || (threads > DEMOD_MAX_THREADS) )
+        return( false );
+    params.demod_threads = threads ;
+    return( true );
+}
+
+// "agc", "tuner" or a gain in dB, the nearest one the tuner has is used
+bool ADSBPlugin::setGain( const char *gain ) {
+    if( strcmp( gain, "agc" ) == 0 ) {
+        params.gain_mode = GAIN_AGC ;
+        return( true );
+    }
+    if( strcmp( gain, "tuner" ) == 0 ) {
+        params.gain_mode = GAIN_TUNER ;
+        return( true );
+    }
+    char *end ;
+    double db = strtod( gain, &end );
+    if( (end == gain) || (*end != 0) || (db < 0) || (db > 60) )
+        return( false );
+    params.gain_mode = GAIN_FIXED ;
+    params.gain = (int)lround( db * 10 );
+    return( true );
+}
+
+bool ADSBPlugin::setAffinity( const char *stage, int cpu ) {
+    static const char *names[PIPELINE_STAGES] = { "usb", "demod", "decode", "publish" };
+    if( (cpu < -1) || (cpu >= CPU_SETSIZE) )
+        return( false );
+    for( int i = 0 ; i < PIPELINE_STAGES ; i++ ) {
+        if( strcmp( stage, names[i] ) == 0 ) {
+            params.affinity[i] = cpu ;
+            return( true );
+        }
+    }
+    return( false );
+}
+
+BinaryUpdateQueue *ADSBPlugin::binaryQueue() {
+    return( params.binary );
+}
+
+ModeSDecoder *ADSBPlugin::decoder() {
+    return( params.decoder );
+}
+
 bool ADSBPlugin::isRunning() {
     return( adsb != nullptr );
 }
@@ -54,40 +275,96 @@ bool ADSBPlugin::isRunning() {
 void ADSBPlugin::stop() {
     if( adsb != nullptr ) {
         params.stop = true ;
-        rtlsdr_cancel_async( params.rtlsdr_device ) ;
+        for( int i = 0 ; i < params.receiver_count ; i++ ) {
+            rtlsdr_cancel_async( params.receivers[i].device ) ;
+        }
         if( adsb->joinable() )
             adsb->join();
+        delete adsb ;
         adsb = nullptr ;
+        closeDevices();
     }
 }
 
-void adsb_thread( ADSBThreadParams *params ) ;
-bool ADSBPlugin::start(char *rtlsdr_serial_number) {
+void ADSBPlugin::closeDevices() {
+    for( int i = 0 ; i < params.receiver_count ; i++ ) {
+        if( params.receivers[i].device != nullptr ) {
+            rtlsdr_close( params.receivers[i].device );
+            params.receivers[i].device = nullptr ;
+        }
+    }
+}
+
+// serial == nullptr or "" opens the first device
+static rtlsdr_dev_t *openDevice( const char *serial ) {
     rtlsdr_dev_t *device ;
     int dev_index = 0 ;
 
-    if( adsb != nullptr) {
-        return(false);
-    }
-
-    if( rtlsdr_serial_number != nullptr ) {
-        dev_index = rtlsdr_get_index_by_serial( (const char *)rtlsdr_serial_number );
+    if( (serial != nullptr) && (serial[0] != 0) ) {
+        dev_index = rtlsdr_get_index_by_serial( serial );
         if( dev_index < 0 ) {
-            fprintf( stderr, "Could not find RTLSDR device with serial [%s]\n", rtlsdr_serial_number );
+            fprintf( stderr, "Could not find RTLSDR device with serial [%s]\n", serial );
             fflush(stderr);
-            return(false);
+            return( nullptr );
         }
     }
     int rc = rtlsdr_open( &device, dev_index );
     if( rc < 0 ) {
         fprintf( stderr, "Could not open RTLSDR device\n");
         fflush(stderr);
+        return( nullptr );
+    }
+    return( device );
+}
+
+void adsb_thread( ADSBThreadParams *params ) ;
+// rtlsdr_serial_numbers : one serial, or several separated by commas to
+// merge the frames of up to ADSB_MAX_RECEIVERS devices.
+// sample_rate : SAMPLE_RATE, or SAMPLE_RATE_2400 for the fractional bit
+// demodulator, which finds more frames for more cpu
+bool ADSBPlugin::start(char *rtlsdr_serial_numbers, int sample_rate) {
+    if( adsb != nullptr) {
+        return(false);
+    }
+    if( (sample_rate != SAMPLE_RATE) && (sample_rate != SAMPLE_RATE_2400) ) {
+        fprintf( stderr, "Unsupported sample rate %d\n", sample_rate );
+        fflush(stderr);
         return(false);
     }
-    params.rtlsdr_device = device ;
+    params.sample_rate = sample_rate ;
+
+    const char *serials = rtlsdr_serial_numbers != nullptr ? rtlsdr_serial_numbers : "" ;
+    params.receiver_count = 0 ;
+    for( ;; ) {
+        const char *end = strchr( serials, ',' );
+        size_t len = end != nullptr ? (size_t)(end - serials) : strlen( serials );
+        if( (params.receiver_count == ADSB_MAX_RECEIVERS) || (len >= ADSB_SERIAL_MAXLEN) ) {
+            fprintf( stderr, "Too many RTLSDR devices or serial too long\n");
+            fflush(stderr);
+            closeDevices();
+            params.receiver_count = 0 ;
+            return(false);
+        }
+        ADSBReceiver *rx = &params.receivers[params.receiver_count] ;
+        memcpy( rx->serial, serials, len );
+        rx->serial[len] = 0 ;
+        rx->device = openDevice( rx->serial );
+        if( rx->device == nullptr ) {
+            closeDevices();
+            params.receiver_count = 0 ;
+            return(false);
+        }
+        rx->frame_count = 0 ;
+        rx->signal_sum = 0 ;
+        rx->duplicates = 0 ;
+        rx->valid_frames = 0 ;
+        params.receiver_count++ ;
+        if( end == nullptr )
+            break ;
+        serials = end + 1 ;
+    }
     params.stop = false ;
     params.box  = box ;
-    params.queue = new TrtlQueue(10);
     adsb = new std::thread( adsb_thread, &params );
     return( true );
 }
@@ -96,11 +373,59 @@ bool ADSBPlugin::start(char *rtlsdr_serial_number) {
 int isrunning_call( void *stack ) ;
 int stop_call( void* stack ) ;
 int start_call( void* stack ) ;
+int gettrail_call( void* stack ) ;
+int setreceiverlocation_call( void* stack ) ;
+int predictposition_call( void* stack ) ;
+int setupdateinterval_call( void* stack ) ;
+int getstats_call( void* stack ) ;
+int setoutputformat_call( void* stack ) ;
+int readupdates_call( void* stack ) ;
+int setbatching_call( void* stack ) ;
+int getaircraft_call( void* stack ) ;
+int listaircraft_call( void* stack ) ;
+int aircraftcount_call( void* stack ) ;
+int setfilter_call( void* stack ) ;
+int startbeastserver_call( void* stack ) ;
+int startsbsserver_call( void* stack ) ;
+int startavrserver_call( void* stack ) ;
+int setavrformat_call( void* stack ) ;
+int startjsonwriter_call( void* stack ) ;
+int setsharedmemory_call( void* stack ) ;
+int startmulticast_call( void* stack ) ;
+int startwebsocketserver_call( void* stack ) ;
+int setaffinity_call( void* stack ) ;
+int setdemodthreads_call( void* stack ) ;
+int setrepairthreads_call( void* stack ) ;
+int setgain_call( void* stack ) ;
 
 void ADSBPlugin::declareMethods( ISDRVirtualMachineEnv *host ) {
     host->addMethod( (const char *)"isRunning", isrunning_call, false);
     host->addMethod( (const char *)"start", start_call, true);
     host->addMethod( (const char *)"stop", stop_call, false);
+    host->addMethod( (const char *)"getTrail", gettrail_call, true);
+    host->addMethod( (const char *)"setReceiverLocation", setreceiverlocation_call, true);
+    host->addMethod( (const char *)"predictPosition", predictposition_call, true);
+    host->addMethod( (const char *)"setUpdateInterval", setupdateinterval_call, true);
+    host->addMethod( (const char *)"getStats", getstats_call, false);
+    host->addMethod( (const char *)"setOutputFormat", setoutputformat_call, true);
+    host->addMethod( (const char *)"readUpdates", readupdates_call, true);
+    host->addMethod( (const char *)"setBatching", setbatching_call, true);
+    host->addMethod( (const char *)"getAircraft", getaircraft_call, true);
+    host->addMethod( (const char *)"listAircraft", listaircraft_call, false);
+    host->addMethod( (const char *)"aircraftCount", aircraftcount_call, false);
+    host->addMethod( (const char *)"setFilter", setfilter_call, true);
+    host->addMethod( (const char *)"startBeastServer", startbeastserver_call, true);
+    host->addMethod( (const char *)"startSBSServer", startsbsserver_call, true);
+    host->addMethod( (const char *)"startAVRServer", startavrserver_call, true);
+    host->addMethod( (const char *)"setAVRFormat", setavrformat_call, true);
+    host->addMethod( (const char *)"startJSONWriter", startjsonwriter_call, true);
+    host->addMethod( (const char *)"setSharedMemory", setsharedmemory_call, true);
+    host->addMethod( (const char *)"startMulticast", startmulticast_call, true);
+    host->addMethod( (const char *)"startWebSocketServer", startwebsocketserver_call, true);
+    host->addMethod( (const char *)"setAffinity", setaffinity_call, true);
+    host->addMethod( (const char *)"setDemodThreads", setdemodthreads_call, true);
+    host->addMethod( (const char *)"setRepairThreads", setrepairthreads_call, true);
+    host->addMethod( (const char *)"setGain", setgain_call, true);
 }
 
 int isrunning_call( void *stack ) {
@@ -135,133 +460,863 @@ int start_call( void* stack ) {
         vmtools->pushBool( stack, false );
         return(1);
     }
+    // "serial" or "serial1,serial2,..." for several devices at one site,
+    // then 2000000 (default) or 2400000 samples per second
     const char *rtlsdr_serial_no = nullptr ;
+    int sample_rate = SAMPLE_RATE ;
     int n = vmtools->getStackSize( stack );
     if( n > 0 ) {
         rtlsdr_serial_no = vmtools->getString( stack, 0);
     }
-    bool res = p->start( (char *)rtlsdr_serial_no );
+    if( n > 1 ) {
+        sample_rate = vmtools->getInt( stack, 1 );
+    }
+    bool res = p->start( (char *)rtlsdr_serial_no, sample_rate );
     vmtools->pushBool( stack, res );
     return(1);
 }
 
+// returns the trail of one aircraft as a JSON array, oldest point first
+int gettrail_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    if( (p == nullptr) || (vmtools->getStackSize(stack) < 1) ) {
+        vmtools->pushString( stack, "[]" );
+        return(1);
+    }
+    uint32_t icao = (uint32_t)vmtools->getInt( stack, 0 );
+    TrackPoint points[TRACK_HISTORY_LEN] ;
+    uint64_t base = 0 ;
+    int n = p->decoder()->getTrail( icao, points, TRACK_HISTORY_LEN, &base );
+
+    json trail = json::array();
+    for( int i = 0 ; i < n ; i++ ) {
+        json point ;
+        point["lat"] = points[i].lat / 1e7 ;
+        point["lon"] = points[i].lon / 1e7 ;
+        point["altitude"] = points[i].altitude ;
+        point["time"] = base + points[i].dt ;
+        trail.push_back( point );
+    }
+    vmtools->pushString( stack, trail.dump().c_str() );
+    return(1);
+}
+
+// predictPosition( icao [, ms_ahead] ) : extrapolated position from the tracking filter
+int predictposition_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    int n = vmtools->getStackSize( stack );
+    if( (p == nullptr) || (n < 1) ) {
+        vmtools->pushString( stack, "{}" );
+        return(1);
+    }
+    uint32_t icao = (uint32_t)vmtools->getInt( stack, 0 );
+    uint64_t at = getTimeStamp();
+    if( n > 1 ) {
+        at += vmtools->getInt( stack, 1 );
+    }
+    double lat, lon ;
+    int altitude ;
+    if( !p->decoder()->predictPosition( icao, at, &lat, &lon, &altitude ) ) {
+        vmtools->pushString( stack, "{}" );
+        return(1);
+    }
+    json result ;
+    result["icao"] = icao ;
+    result["lat"] = lat ;
+    result["lon"] = lon ;
+    result["altitude"] = altitude ;
+    result["time"] = at ;
+    vmtools->pushString( stack, result.dump().c_str() );
+    return(1);
+}
+
+// setReceiverLocation( lat, lon [, range_km] ) : only allowed while stopped
+int setreceiverlocation_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    int n = vmtools->getStackSize( stack );
+    if( (p == nullptr) || p->isRunning() || (n < 2) ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    double lat = vmtools->getDouble( stack, 0 );
+    double lon = vmtools->getDouble( stack, 1 );
+    double range_km = MODES_MAX_RANGE ;
+    if( n > 2 ) {
+        range_km = vmtools->getDouble( stack, 2 );
+    }
+    p->decoder()->setReceiverLocation( lat, lon, range_km );
+    vmtools->pushBool( stack, true );
+    return(1);
+}
+
+// setUpdateInterval( ms ) : minimum time between two updates of the same
+// aircraft, 0 sends every update. Only allowed while stopped
+int setupdateinterval_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    if( (p == nullptr) || p->isRunning() || (vmtools->getStackSize(stack) < 1) ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    p->setUpdateInterval( vmtools->getInt( stack, 0 ) );
+    vmtools->pushBool( stack, true );
+    return(1);
+}
+
+int getstats_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    if( p == nullptr ) {
+        vmtools->pushString( stack, "{}" );
+        return(1);
+    }
+    ModeSStats stats ;
+    p->decoder()->getStats( &stats );
+
+    json result ;
+    result["messages"] = stats.messages ;
+    result["accepted_positions"] = stats.accepted_positions ;
+    result["rejected_positions"] = stats.rejected_positions ;
+    result["repaired"] = stats.repaired ;
+    result["repair_failed"] = stats.repair_failed ;
+    result["repair_shed"] = stats.repair_shed ;
+    PipelineStats pipeline ;
+    p->getPipelineStats( &pipeline );
+    result["dropped_blocks"] = pipeline.dropped_blocks ;
+    result["dropped_frames"] = pipeline.dropped_frames ;
+    result["dropped_updates"] = pipeline.dropped_updates ;
+    ReceiverStats receivers[ADSB_MAX_RECEIVERS] ;
+    int count = p->getReceiverStats( receivers );
+    result["receivers"] = json::array();
+    for( int i = 0 ; i < count ; i++ ) {
+        json rx ;
+        rx["serial"] = receivers[i].serial ;
+        rx["frames"] = receivers[i].frames ;
+        rx["duplicates"] = receivers[i].duplicates ;
+        rx["signal"] = receivers[i].signal ;
+        rx["noise_floor"] = round( receivers[i].noise_floor * 10 ) / 10 ;
+        if( receivers[i].gain == AUTO_GAIN ) {
+            rx["gain"] = "tuner" ;
+        } else {
+            rx["gain"] = receivers[i].gain / 10.0 ;
+        }
+        result["receivers"].push_back( rx );
+    }
+    if( p->binaryQueue() != nullptr ) {
+        result["binary_dropped"] = p->binaryQueue()->dropped() ;
+    }
+    if( p->beastServer()->isRunning() ) {
+        result["beast_clients"] = p->beastServer()->clientCount() ;
+        result["beast_dropped_clients"] = p->beastServer()->droppedClients() ;
+    }
+    if( p->sbsServer()->isRunning() ) {
+        result["sbs_clients"] = p->sbsServer()->clientCount() ;
+        result["sbs_dropped_clients"] = p->sbsServer()->droppedClients() ;
+    }
+    if( p->avrServer()->isRunning() ) {
+        result["avr_clients"] = p->avrServer()->clientCount() ;
+        result["avr_dropped_clients"] = p->avrServer()->droppedClients() ;
+    }
+    if( p->websocketServer()->isRunning() ) {
+        result["websocket_clients"] = p->websocketServer()->clientCount() ;
+        result["websocket_dropped_clients"] = p->websocketServer()->droppedClients() ;
+    }
+    if( p->multicast()->isRunning() ) {
+        result["multicast_dropped"] = p->multicast()->droppedRecords() ;
+    }
+    vmtools->pushString( stack, result.dump().c_str() );
+    return(1);
+}
+
+// setOutputFormat( "json" | "binary" | "avr" ) : only allowed while stopped.
+// "avr" posts the raw frames as JSON strings and skips the decoder
+int setoutputformat_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    if( (p == nullptr) || p->isRunning() || (vmtools->getStackSize(stack) < 1) ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    const char *format = vmtools->getString( stack, 0 );
+    vmtools->pushBool( stack, (format != nullptr) && p->setOutputFormat( format ) );
+    return(1);
+}
+
+// readUpdates( [max_records] ) : pending binary records as a byte array,
+// see adsbbinary.h for the layout and adsb_binary.js for a decoder. 1024
+// records by default, at most 65536 (the queue capacity)
+int readupdates_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    vmByteArray result ;
+    result.items = 0 ;
+    result.ptr = nullptr ;
+    if( (p == nullptr) || (p->binaryQueue() == nullptr) ) {
+        vmtools->pushByteArray( stack, &result );
+        return(1);
+    }
+    int max_records = 1024 ;
+    if( vmtools->getStackSize(stack) > 0 ) {
+        max_records = vmtools->getInt( stack, 0 );
+    }
+    // never more than the queue holds
+    if( max_records > BINARY_QUEUE_LEN )
+        max_records = BINARY_QUEUE_LEN ;
+    if( max_records > 0 ) {
+        ADSBBinaryUpdate *records = (ADSBBinaryUpdate *)malloc( max_records * sizeof(ADSBBinaryUpdate));
+        if( records != nullptr ) {
+            int n = p->binaryQueue()->pop( records, max_records );
+            result.items = n * sizeof(ADSBBinaryUpdate) ;
+            result.ptr = (unsigned char *)records ;
+        }
+    }
+    vmtools->pushByteArray( stack, &result );
+    free( result.ptr );
+    return(1);
+}
+
+// setBatching( max_updates [, max_latency_ms] ) : post JSON arrays of up to
+// max_updates updates, at most max_latency_ms after the first one was
+// queued. 1 (or 0) posts every update alone. Only allowed while stopped
+int setbatching_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    int n = vmtools->getStackSize( stack );
+    if( (p == nullptr) || p->isRunning() || (n < 1) ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    int max_updates = vmtools->getInt( stack, 0 );
+    int max_latency = DEFAULT_BATCH_LATENCY ;
+    if( n > 1 ) {
+        max_latency = vmtools->getInt( stack, 1 );
+    }
+    p->setBatching( max_updates, max_latency );
+    vmtools->pushBool( stack, true );
+    return(1);
+}
+
+// getAircraft( icao ) : last snapshot of one aircraft as a JSON object,
+// "{}" if unknown
+int getaircraft_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    if( (p == nullptr) || (vmtools->getStackSize(stack) < 1) ) {
+        vmtools->pushString( stack, "{}" );
+        return(1);
+    }
+    uint32_t icao = (uint32_t)vmtools->getInt( stack, 0 );
+    AircraftState ac ;
+    if( !p->decoder()->snapshot()->find( icao, &ac )) {
+        vmtools->pushString( stack, "{}" );
+        return(1);
+    }
+    char text[AIRCRAFT_JSON_MAXLEN] ;
+    JSONWriter w( text, sizeof(text) );
+    writeAircraftState( w, &ac, getTimeStamp() );
+    vmtools->pushString( stack, w.data() );
+    return(1);
+}
+
+// listAircraft() : last snapshot of all aircraft as a JSON array
+int listaircraft_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    if( p == nullptr ) {
+        vmtools->pushString( stack, "[]" );
+        return(1);
+    }
+    AircraftSnapshot *snapshot = p->decoder()->snapshot() ;
+    int max_aircraft = snapshot->capacity() ;
+    AircraftState *table = (AircraftState *)malloc( max_aircraft * sizeof(AircraftState));
+    int n = snapshot->read( table, max_aircraft, nullptr );
+
+    size_t len = n * AIRCRAFT_JSON_MAXLEN + 3 ;
+    char *text = (char *)malloc( len );
+    JSONWriter w( text, len );
+    uint64_t now = getTimeStamp();
+    w.beginArray();
+    for( int i = 0 ; i < n ; i++ ) {
+        writeAircraftState( w, &table[i], now );
+    }
+    w.endArray();
+    vmtools->pushString( stack, w.data() );
+    free( text );
+    free( table );
+    return(1);
+}
+
+int aircraftcount_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    vmtools->pushInt( stack, p == nullptr ? 0 : p->decoder()->snapshot()->count() );
+    return(1);
+}
+
+// setFilter( spec ) : only publish the updates matching the JSON spec,
+// see updatefilter.h. "{}" removes the filter
+int setfilter_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    if( (p == nullptr) || (vmtools->getStackSize(stack) < 1) ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    const char *spec = vmtools->getString( stack, 0 );
+    vmtools->pushBool( stack, (spec != nullptr) && p->setFilter( spec ) );
+    return(1);
+}
+
+// startBeastServer( [port] ) : stream the valid frames in Beast binary format
+// to TCP clients, default port 30005. Port 0 stops the server
+int startbeastserver_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    if( p == nullptr ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    int port = DEFAULT_BEAST_PORT ;
+    if( vmtools->getStackSize(stack) > 0 ) {
+        port = vmtools->getInt( stack, 0 );
+    }
+    p->beastServer()->stop();
+    if( port == 0 ) {
+        vmtools->pushBool( stack, true );
+        return(1);
+    }
+    vmtools->pushBool( stack, p->beastServer()->start( port ) );
+    return(1);
+}
+
+// startSBSServer( [port] ) : stream the decoded aircraft changes as SBS-1
+// BaseStation lines to TCP clients, default port 30003. Port 0 stops the server
+int startsbsserver_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    if( p == nullptr ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    int port = DEFAULT_SBS_PORT ;
+    if( vmtools->getStackSize(stack) > 0 ) {
+        port = vmtools->getInt( stack, 0 );
+    }
+    p->sbsServer()->stop();
+    if( port == 0 ) {
+        vmtools->pushBool( stack, true );
+        return(1);
+    }
+    vmtools->pushBool( stack, p->sbsServer()->start( port ) );
+    return(1);
+}
+
+// startAVRServer( [port] ) : stream every frame found by the framer as AVR
+// text to TCP clients, default port 30002. Port 0 stops the server
+int startavrserver_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    if( p == nullptr ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    int port = DEFAULT_AVR_PORT ;
+    if( vmtools->getStackSize(stack) > 0 ) {
+        port = vmtools->getInt( stack, 0 );
+    }
+    p->avrServer()->stop();
+    if( port == 0 ) {
+        vmtools->pushBool( stack, true );
+        return(1);
+    }
+    vmtools->pushBool( stack, p->avrServer()->start( port ) );
+    return(1);
+}
+
+// setAVRFormat( "plain" | "timestamp" | "rssi" ) : only allowed while stopped
+int setavrformat_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    if( (p == nullptr) || p->isRunning() || (vmtools->getStackSize(stack) < 1) ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    const char *format = vmtools->getString( stack, 0 );
+    vmtools->pushBool( stack, (format != nullptr) && p->setAVRFormat( format ) );
+    return(1);
+}
+
+// startJSONWriter( path [, ms] ) : write the aircraft table to path as a
+// dump1090 aircraft.json every ms (default 1000). An empty path stops it
+int startjsonwriter_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    int n = vmtools->getStackSize( stack );
+    if( (p == nullptr) || (n < 1) ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    const char *path = vmtools->getString( stack, 0 );
+    int interval = DEFAULT_JSON_INTERVAL ;
+    if( n > 1 ) {
+        interval = vmtools->getInt( stack, 1 );
+    }
+    if( (path == nullptr) || (path[0] == 0) ) {
+        p->jsonWriter()->stop();
+        vmtools->pushBool( stack, true );
+        return(1);
+    }
+    vmtools->pushBool( stack, p->jsonWriter()->start( path, interval ) );
+    return(1);
+}
+
+// setSharedMemory( [name [, capacity]] ) : also publish the updates as binary
+// records in a POSIX shared memory ring, see adsbshm.h. An empty name
+// removes it. Only allowed while stopped
+int setsharedmemory_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    int n = vmtools->getStackSize( stack );
+    if( (p == nullptr) || p->isRunning() ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    const char *name = ADSB_SHM_DEFAULT_NAME ;
+    int capacity = ADSB_SHM_DEFAULT_CAPACITY ;
+    if( n > 0 ) {
+        name = vmtools->getString( stack, 0 );
+    }
+    if( n > 1 ) {
+        capacity = vmtools->getInt( stack, 1 );
+    }
+    if( (name == nullptr) || (name[0] == 0) ) {
+        p->sharedMemory()->close();
+        vmtools->pushBool( stack, true );
+        return(1);
+    }
+    vmtools->pushBool( stack, (capacity > 0) && p->sharedMemory()->open( name, capacity ) );
+    return(1);
+}
+
+// startMulticast( group, port [, ttl [, "frames" | "updates" | "both"]] ) :
+// send the valid frames and/or the updates as UDP multicast datagrams, see
+// adsbmulticast.h. An empty group stops it
+int startmulticast_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    int n = vmtools->getStackSize( stack );
+    if( (p == nullptr) || (n < 1) ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    const char *group = vmtools->getString( stack, 0 );
+    p->multicast()->stop();
+    if( (group == nullptr) || (group[0] == 0) ) {
+        vmtools->pushBool( stack, true );
+        return(1);
+    }
+    if( n < 2 ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    int port = vmtools->getInt( stack, 1 );
+    int ttl = 1 ;
+    int content = MULTICAST_FRAMES | MULTICAST_UPDATES ;
+    if( n > 2 ) {
+        ttl = vmtools->getInt( stack, 2 );
+    }
+    if( n > 3 ) {
+        const char *what = vmtools->getString( stack, 3 );
+        if( (what != nullptr) && (strcmp( what, "frames" ) == 0) )
+            content = MULTICAST_FRAMES ;
+        else if( (what != nullptr) && (strcmp( what, "updates" ) == 0) )
+            content = MULTICAST_UPDATES ;
+    }
+    vmtools->pushBool( stack, p->multicast()->start( group, port, ttl, content ) );
+    return(1);
+}
+
+// startWebSocketServer( [port [, ms]] ) : live aircraft feed for browser maps,
+// the table on connect then the changed fields every ms (default 1000), see
+// websocketserver.h. Default port 8080, port 0 stops the server
+int startwebsocketserver_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    int n = vmtools->getStackSize( stack );
+    if( p == nullptr ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    int port = DEFAULT_WEBSOCKET_PORT ;
+    int tick = DEFAULT_WEBSOCKET_TICK ;
+    if( n > 0 ) {
+        port = vmtools->getInt( stack, 0 );
+    }
+    if( n > 1 ) {
+        tick = vmtools->getInt( stack, 1 );
+    }
+    p->websocketServer()->stop();
+    if( port == 0 ) {
+        vmtools->pushBool( stack, true );
+        return(1);
+    }
+    vmtools->pushBool( stack, p->websocketServer()->start( port, tick ) );
+    return(1);
+}
+
+// setAffinity( "usb" | "demod" | "decode" | "publish", cpu ) : run a stage of
+// the receive pipeline on one cpu, -1 for any. With several receivers, the
+// usb and demod threads of all of them share it. Only allowed while stopped
+int setaffinity_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    if( (p == nullptr) || p->isRunning() || (vmtools->getStackSize(stack) < 2) ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    const char *stage = vmtools->getString( stack, 0 );
+    int cpu = vmtools->getInt( stack, 1 );
+    vmtools->pushBool( stack, (stage != nullptr) && p->setAffinity( stage, cpu ) );
+    return(1);
+}
+
+// setDemodThreads( n ) : split each block in n chunks demodulated in
+// parallel, for high sample rates. 1 by default, only allowed while stopped
+int setdemodthreads_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    if( (p == nullptr) || p->isRunning() || (vmtools->getStackSize(stack) < 1) ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    vmtools->pushBool( stack, p->setDemodThreads( vmtools->getInt( stack, 0 )) );
+    return(1);
+}
+
+// setRepairThreads( n ) : threads fixing the two bit errors of DF17 frames
+// off the decoder thread, 1 by default. 0 fixes them inline. Only allowed
+// while stopped
+int setrepairthreads_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    if( (p == nullptr) || p->isRunning() || (vmtools->getStackSize(stack) < 1) ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    vmtools->pushBool( stack, p->decoder()->setRepairThreads( vmtools->getInt( stack, 0 )) );
+    return(1);
+}
+
+// setGain( "agc" | "tuner" | db ) : "agc" (default) steps through the tuner
+// gains to decode the most frames, "tuner" leaves it to the tuner, a number
+// of dB sets a fixed gain. Only allowed while stopped
+int setgain_call( void* stack ) {
+    ADSBPlugin* p = (ADSBPlugin *)vmtools->getObject(stack);
+    if( (p == nullptr) || p->isRunning() || (vmtools->getStackSize(stack) < 1) ) {
+        vmtools->pushBool( stack, false );
+        return(1);
+    }
+    const char *gain = vmtools->getString( stack, 0 );
+    vmtools->pushBool( stack, (gain != nullptr) && p->setGain( gain ) );
+    return(1);
+}
+
+// pin the calling thread on one cpu, -1 leaves it to the scheduler
+static void setThreadAffinity( int cpu ) {
+    if( cpu < 0 )
+        return ;
+    cpu_set_t set ;
+    CPU_ZERO( &set );
+    CPU_SET( cpu, &set );
+    if( pthread_setaffinity_np( pthread_self(), sizeof(set), &set ) != 0 ) {
+        fprintf( stderr, "Could not set the affinity to cpu %d\n", cpu );
+        fflush(stderr);
+    }
+}
+
 void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx) {
     TrtlQueue *q = (TrtlQueue *)ctx ;
-    if( q->isFull())
-        return ;
     RTLSDRBlock* block = (RTLSDRBlock *)malloc( sizeof(RTLSDRBlock));
     if( block == nullptr )
         return ;
     block->len = len ;
     block->buf = (unsigned char *)malloc( len *sizeof(unsigned char));
-    if( block->buf == nullptr )
+    if( block->buf == nullptr ) {
+        free( block );
         return ;
+    }
     memcpy( block->buf, buf, len *sizeof(unsigned char));
-    q->add( block );
+    // demod too slow : the block is lost, counted by the queue
+    if( !q->push( block )) {
+        free( block->buf );
+        free( block );
+    }
 }
 
-void rtlsdr_thread( ADSBThreadParams *params ) {
-    rtlsdr_dev_t *rtlsdr_device = params->rtlsdr_device ;
-    rtlsdr_reset_buffer(rtlsdr_device);
-    rtlsdr_read_async(rtlsdr_device, rtlsdr_callback, (void *)params->queue, 0, 65536);
-    // push a 0-len queue to unlock main thread
-    RTLSDRBlock* block = (RTLSDRBlock *)malloc( sizeof(RTLSDRBlock));
-    block->len = 0 ;
-    block->buf = nullptr ;
-    params->queue->add(block);
+void rtlsdr_thread( ADSBThreadParams *params, ADSBReceiver *rx ) {
+    setThreadAffinity( params->affinity[PIPELINE_USB] );
+    rtlsdr_reset_buffer( rx->device );
+    rtlsdr_read_async( rx->device, rtlsdr_callback, (void *)rx->queue, 0, 65536);
+    rx->streaming = false ;
 }
 
-void postMessage( TMBox *box, ADSBUpdate *msg ) {
-    uint8_t  update_type = msg->update_type ;
-    uint32_t icao = msg->addr ;
-    std::string jsonsource ;
-
-    json mail ;
-    mail["icao"] = icao ;
-    mail["update_type"] = update_type ;
-    if( msg->ac != nullptr ) {
-        mail["flight"] = std::string( msg->ac->flight );
-        mail["altitude"] = msg->ac->altitude ;
-        mail["speed"] = msg->ac->speed ;
-        mail["vert_rate_sign"] = msg->ac->vert_rate_sign ;
-        mail["vert_rate"] = msg->ac->vert_rate ;
-        mail["position_valid"] = msg->ac->position_valid ;
-        mail["lat"] = msg->ac->lat ;
-        mail["lon"] = msg->ac->lon ;
+// decode_thread side of the update output, before the publish stage
+void publishUpdate( ADSBThreadParams *params, ADSBUpdate *msg ) {
+    if( !params->filter->match( msg )) {
+        free( msg );
+        return ;
     }
+    if( params->shm->isOpen() )
+        params->shm->push( msg );
+    params->multicast->pushUpdate( msg );
+    PublishItem item = { msg, nullptr } ;
+    if( !params->updates->push( item ))
+        free( msg );
+}
 
-    if( update_type == ADSBUPDATE_TYPE_AIRCRAFTLOST ) {
-        mail["update_type_msg"] = "ADSBUPDATE_TYPE_AIRCRAFTLOST" ;
+// one frame through the decoder and the frame level outputs, then frees it.
+// sbs is null when the SBS server is stopped
+static void decodeFrame( ADSBThreadParams *params, ADSBRawMSG *raw, SBSEncoder *sbs,
+                         UpdateCoalescer& coalescer, uint64_t now ) {
+    ModeSDecoder& modeS = *params->decoder ;
+    bool valid = modeS.pushRawMSG( raw );
+    if( valid && params->beast->isRunning() ) {
+        uint8_t frame[BEAST_FRAME_MAXLEN] ;
+        params->beast->write( frame, encodeBeastFrame( frame, raw ));
     }
-    if( update_type == ADSBUPDATE_TYPE_AIRCRAFTMOVE ) {
-        mail["update_type_msg"] = "ADSBUPDATE_TYPE_AIRCRAFTMOVE" ;
+    if( valid ) {
+        params->receivers[raw->receiver].valid_frames++ ;
+        params->multicast->pushFrame( raw );
     }
-    if( update_type == ADSBUPDATE_TYPE_NEWAIRCRAFT ) {
-        mail["update_type_msg"] = "ADSBUPDATE_TYPE_NEWAIRCRAFT" ;
+    free( raw->msg );
+    free( raw );
+    while( modeS.hasMSG() ) {
+        ADSBUpdate *msg = modeS.popMSG() ;
+        if( sbs != nullptr ) {
+            // every change, before rate limiting
+            char lines[SBS_UPDATE_MAXLEN] ;
+            params->sbs->write( lines, sbs->encode( msg, lines ));
+        }
+        params->websocket->push( msg );
+        coalescer.push( msg, now );
     }
-    jsonsource = mail.dump();
-    free(msg);
+}
 
-   // fprintf( stdout, "%s\n", jsonsource.c_str() ); fflush(stdout);
+static bool framesWaiting( ADSBThreadParams *params ) {
+    for( int i = 0 ; i < params->receiver_count ; i++ ) {
+        if( !params->receivers[i].frames->isEmpty() )
+            return( true );
+    }
+    return( false );
+}
 
-    TMBoxMessage *boxmessage = (TMBoxMessage *)malloc( sizeof(TMBoxMessage));
-    boxmessage->fromTID = 0 ;
-    boxmessage->memsize = jsonsource.length() + 1 ;
-    boxmessage->payload = (char *)malloc( boxmessage->memsize);
-    sprintf( boxmessage->payload, "%s", jsonsource.c_str());
-    box->postMessage( boxmessage );
+// next frame of any receiver, taken in turn so none can starve the others
+static bool popFrame( ADSBThreadParams *params, int& next, ADSBRawMSG *& raw ) {
+    for( int n = 0 ; n < params->receiver_count ; n++ ) {
+        ADSBReceiver *rx = &params->receivers[next] ;
+        next = (next + 1) % params->receiver_count ;
+        if( rx->frames->pop( raw ))
+            return( true );
+    }
+    return( false );
 }
 
-void adsb_thread( ADSBThreadParams *params ) {
-    int rc ;
+// decode stage : decoder, aircraft state and every network output
+void decode_thread( ADSBThreadParams *params ) {
+    setThreadAffinity( params->affinity[PIPELINE_DECODE] );
+    ModeSDecoder& modeS = *params->decoder ;
+    UpdateCoalescer coalescer( params->update_interval );
+    SBSEncoder sbs ;
+    FrameDedup dedup ;
+    bool merge = params->receiver_count > 1 ;
+    int next = 0 ;
+    while( !params->stop ) {
+        ADSBRawMSG *raw ;
+        params->frames_signal.wait( [params]() { return framesWaiting( params ); }, PIPELINE_WAIT );
+        uint64_t now = getTimeStamp();
+        UpdateFilter *filter = params->new_filter.exchange( nullptr );
+        if( filter != nullptr ) {
+            delete params->filter ;
+            params->filter = filter ;
+        }
+        bool avr_output = params->output_format == ADSB_OUTPUT_AVR ;
+        bool sbs_output = params->sbs->isRunning() ;
+        if( sbs_output )
+            sbs.setTime( now );
+        // whatever is queued, then the outputs are flushed
+        while( popFrame( params, next, raw )) {
+            if( merge && dedup.isDuplicate( raw, now )) {
+                params->receivers[raw->receiver].duplicates++ ;
+                free( raw->msg );
+                free( raw );
+                continue ;
+            }
+            if( params->avr->isRunning() ) {
+                char line[AVR_FRAME_MAXLEN] ;
+                params->avr->write( line, encodeAVRFrame( line, raw, params->avr_format ));
+            }
+            if( avr_output ) {
+                // frame level output only, no aircraft state
+                PublishItem item = { nullptr, raw } ;
+                if( !params->updates->push( item )) {
+                    free( raw->msg );
+                    free( raw );
+                }
+                continue ;
+            }
+            decodeFrame( params, raw, sbs_output ? &sbs : nullptr, coalescer, now );
+        }
+        // frames the repair pool fixed meanwhile, oldest first
+        while( (raw = modeS.popRepaired()) != nullptr ) {
+            if( merge && dedup.isDuplicate( raw, now )) {
+                params->receivers[raw->receiver].duplicates++ ;
+                free( raw->msg );
+                free( raw );
+                continue ;
+            }
+            decodeFrame( params, raw, sbs_output ? &sbs : nullptr, coalescer, now );
+        }
+        params->beast->publish();
+        params->sbs->publish();
+        params->avr->publish();
+        coalescer.flush( now );
+        while( coalescer.hasMSG() ) {
+            publishUpdate( params, coalescer.popMSG() );
+        }
+        params->multicast->publish();
+        params->websocket->tick( now );
+        modeS.publishSnapshot( now );
+    }
+}
+
+// publish stage : the outputs read by the scripts, which may be slow
+void publish_thread( ADSBThreadParams *params ) {
+    setThreadAffinity( params->affinity[PIPELINE_PUBLISH] );
+    MailboxPublisher mailbox( params->box );
+    mailbox.setBatching( params->batch_updates, params->batch_latency );
+    while( !params->stop ) {
+        PublishItem item ;
+        bool more = params->updates->wait( item, PIPELINE_WAIT );
+        uint64_t now = getTimeStamp();
+        for( ; more ; more = params->updates->pop( item )) {
+            if( item.frame != nullptr ) {
+                char line[AVR_FRAME_MAXLEN] ;
+                size_t len = encodeAVRFrame( line, item.frame, params->avr_format );
+                line[len-1] = 0 ;   // no newline in the mailbox
+                mailbox.publishText( line, now );
+                free( item.frame->msg );
+                free( item.frame );
+                continue ;
+            }
+            if( params->output_format == ADSB_OUTPUT_BINARY ) {
+                params->binary->push( item.update );
+                free( item.update );
+                continue ;
+            }
+            mailbox.publish( item.update, now );
+        }
+        mailbox.poll( now );
+    }
+}
+
+// demod stage of one receiver
+void demod_thread( ADSBThreadParams *params, int index ) {
+    ADSBReceiver *rx = &params->receivers[index] ;
     RTLSDRBlock* block ;
-    rtlsdr_dev_t *rtlsdr_device = params->rtlsdr_device ;
-    TMBox *box = params->box ;
-    TrtlQueue *queue = params->queue ;
+    setThreadAffinity( params->affinity[PIPELINE_DEMOD] );
+    ADSBFramer framer( params->demod_threads, params->sample_rate );
+    GainController agc( rx->device, params->sample_rate, params->output_format != ADSB_OUTPUT_AVR );
+    if( !agc.start( params->gain_mode, params->gain )) {
+        fprintf(stderr, "Error: Failed to set the tuner gain.\n");
+        fflush(stderr);
+    }
+    rx->gain = agc.gain();
+    FramerStats stats ;
+    while( !params->stop ) {
+        if( !rx->queue->wait( block, PIPELINE_WAIT ))
+            continue ;
+        // push radio block
+        framer.newDatas( (char *)block->buf, block->len );
+        free( block->buf );
+        free(block);
+        framer.getStats( &stats );
+        // a duplicate is a valid frame the other receiver decoded first
+        agc.update( &stats, rx->valid_frames + rx->duplicates );
+        rx->gain = agc.gain();
+        rx->noise_floor = framer.noiseFloor();
+        //
+        while( framer.hasFrames() ) {
+            ADSBRawMSG *raw = framer.pop() ;
+            if( raw == nullptr ) continue ;
+            raw->receiver = (uint8_t)index ;
+            rx->frame_count++ ;
+            rx->signal_sum += raw->signal ;
+            if( !rx->frames->push( raw )) {
+                // decode too slow, counted by the queue
+                free( raw->msg );
+                free( raw );
+            }
+        }
+    }
+}
 
-    rc = rtlsdr_reset_buffer(rtlsdr_device);
+static bool setupDevice( rtlsdr_dev_t *rtlsdr_device, int sample_rate ) {
+    int rc = rtlsdr_reset_buffer(rtlsdr_device);
     if (rc < 0) {
         fprintf(stderr, "Error: Failed to reset buffers.\n");
         fflush(stderr);
-        return ;
+        return( false );
     }
-    rtlsdr_set_tuner_gain_mode( rtlsdr_device, 0);
     rc = rtlsdr_set_center_freq( rtlsdr_device, 1090e6 );
     if (rc != 0) {
         fprintf(stderr, "Error: Failed to set center frequency.\n");
         fflush(stderr);
-        return ;
+        return( false );
     }
-    rc = rtlsdr_set_sample_rate( rtlsdr_device, 2000000 );
+    rc = rtlsdr_set_sample_rate( rtlsdr_device, sample_rate );
     if( rc != 0) {
         fprintf(stderr, "Error: Failed to set sampling rate.\n");
         fflush(stderr);
-        return ;
+        return( false );
     }
+    return( true );
+}
 
-    new std::thread( rtlsdr_thread, params );
-    ADSBFramer framer ;
-    ModeSDecoder modeS ;
-    while( !params->stop ) {
-        queue->consume(block);
-        if( block->len == 0 ) {
-            free(block);
-            continue ;
+// starts and stops the stages, runs the demod of the first receiver
+void adsb_thread( ADSBThreadParams *params ) {
+    int count = params->receiver_count ;
+    for( int i = 0 ; i < count ; i++ ) {
+        if( !setupDevice( params->receivers[i].device, params->sample_rate ))
+            return ;
+    }
+
+    std::thread publish( publish_thread, params );
+    std::thread decode( decode_thread, params );
+    std::vector<std::thread> usb ;
+    std::vector<std::thread> demod ;
+    for( int i = 0 ; i < count ; i++ ) {
+        params->receivers[i].streaming = true ;
+        usb.push_back( std::thread( rtlsdr_thread, params, &params->receivers[i] ));
+        if( i > 0 )
+            demod.push_back( std::thread( demod_thread, params, i ));
+    }
+    demod_thread( params, 0 );
+
+    for( int i = 0 ; i < count ; i++ ) {
+        ADSBReceiver *rx = &params->receivers[i] ;
+        // stop() may have cancelled the USB transfers before they started
+        while( rx->streaming ) {
+            rtlsdr_cancel_async( rx->device );
+            std::this_thread::sleep_for( std::chrono::milliseconds( PIPELINE_WAIT ));
         }
-        // push radio block
-        framer.newDatas( (char *)block->buf, block->len );
-        free( block->buf );
-        free(block);
-        //
-        while( framer.hasFrames() ) {
-            ADSBRawMSG *raw = framer.pop() ;
-            if( raw == nullptr ) continue ;
-            modeS.pushRawMSG( raw );
-            while( modeS.hasMSG() ) {
-                ADSBUpdate *modeSM = modeS.popMSG();
-                postMessage( box, modeSM );
-            }
+    }
+    for( std::thread& t : usb ) {
+        t.join();
+    }
+    for( std::thread& t : demod ) {
+        t.join();
+    }
+    decode.join();
+    publish.join();
+    for( int i = 0 ; i < count ; i++ ) {
+        ADSBReceiver *rx = &params->receivers[i] ;
+        RTLSDRBlock* block ;
+        while( rx->queue->pop( block )) {
+            free( block->buf );
+            free( block );
+        }
+        ADSBRawMSG *raw ;
+        while( rx->frames->pop( raw )) {
+            free( raw->msg );
+            free( raw );
         }
     }
-
+    PublishItem item ;
+    while( params->updates->pop( item )) {
+        if( item.frame != nullptr ) {
+            free( item.frame->msg );
+            free( item.frame );
+        }
+        free( item.update );
+    }
 }
@@ -12,10 +12,22 @@
 #ifndef EXAMPLEPLUGIN_H
 #define EXAMPLEPLUGIN_H
 #include <thread>
+#include <atomic>
 #include "vmplugins.h"
 #include "vmtypes.h"
 #include "ConsumerProducer.h"
+#include "pipelinequeue.h"
 #include "librtlsdr/rtl-sdr.h"
+#include "modesdecoder.h"
+#include "binaryupdatequeue.h"
+#include "updatefilter.h"
+#include "feedserver.h"
+#include "aircraftjsonwriter.h"
+#include "shmupdatering.h"
+#include "multicastpublisher.h"
+#include "websocketserver.h"
+#include "framededup.h"
+#include "gaincontrol.h"
 
 typedef struct {
     unsigned char *buf ;
@@ -23,13 +35,97 @@ typedef struct {
 
 } RTLSDRBlock ;
 
-typedef ConsumerProducerQueue<RTLSDRBlock *> TrtlQueue ;
+typedef PipelineQueue<RTLSDRBlock *> TrtlQueue ;
 
+/* decode_thread to publish_thread : an update, or in AVR output a frame */
 typedef struct {
-    bool stop ;
-    TMBox *box ;
+    ADSBUpdate *update ;
+    ADSBRawMSG *frame ;
+} PublishItem ;
+
+/* Receive pipeline, one thread per stage :
+ *   usb      rtlsdr_thread, copies the USB transfers
+ *   demod    demod_thread, finds the frames in the samples
+ *   decode   decode_thread, decoder and network outputs
+ *   publish  publish_thread, JSON mailbox messages and binary records
+ * With several receivers, each one has its own usb and demod threads and
+ * the decode stage merges their frames.
+ */
+#define PIPELINE_USB 0
+#define PIPELINE_DEMOD 1
+#define PIPELINE_DECODE 2
+#define PIPELINE_PUBLISH 3
+#define PIPELINE_STAGES 4
+
+#define PIPELINE_BLOCKS 16          /* USB transfers waiting for demod */
+#define PIPELINE_FRAMES 4096        /* frames waiting for decode */
+#define PIPELINE_UPDATES 4096       /* items waiting for publish */
+#define PIPELINE_WAIT 10            /* ms a stage sleeps without input */
+
+#define ADSB_SERIAL_MAXLEN 64
+
+/* items a stage could not take, its queue being full */
+typedef struct {
+    uint64_t dropped_blocks ;
+    uint64_t dropped_frames ;
+    uint64_t dropped_updates ;
+} PipelineStats ;
+
+/* one RTLSDR device and its usb and demod stages */
+typedef struct {
+    char serial[ADSB_SERIAL_MAXLEN] ;   /* empty : first device found */
+    rtlsdr_dev_t *device ;
     TrtlQueue *queue ;
-    rtlsdr_dev_t *rtlsdr_device ;
+    PipelineQueue<ADSBRawMSG *> *frames ;
+    std::atomic<bool> streaming ;       /* rtlsdr_thread is in rtlsdr_read_async */
+    std::atomic<uint64_t> frame_count ;
+    std::atomic<uint64_t> signal_sum ;  /* of the frames, for the average */
+    std::atomic<uint64_t> duplicates ;  /* frames another receiver heard first */
+    std::atomic<uint64_t> valid_frames ;    /* passed the CRC in the decoder */
+    std::atomic<int> gain ;             /* tenth of dB, AUTO_GAIN for the tuner AGC */
+    std::atomic<float> noise_floor ;    /* dBFS */
+} ADSBReceiver ;
+
+typedef struct {
+    char serial[ADSB_SERIAL_MAXLEN] ;
+    uint64_t frames ;
+    uint64_t duplicates ;
+    int signal ;            /* average, 255 = full scale */
+    int gain ;              /* tenth of dB, AUTO_GAIN for the tuner AGC */
+    float noise_floor ;     /* dBFS */
+} ReceiverStats ;
+
+#define ADSB_OUTPUT_JSON 0      /* one JSON mailbox message per update */
+#define ADSB_OUTPUT_BINARY 1    /* ADSBBinaryUpdate records, read with readUpdates() */
+#define ADSB_OUTPUT_AVR 2       /* AVR text frames, nothing is decoded */
+
+typedef struct {
+    std::atomic<bool> stop ;    /* set by stop(), polled by all the stages */
+    TMBox *box ;
+    ADSBReceiver receivers[ADSB_MAX_RECEIVERS] ;
+    int receiver_count ;
+    PipelineSignal frames_signal ;      /* any receiver has frames for decode */
+    PipelineQueue<PublishItem> *updates ;
+    int affinity[PIPELINE_STAGES] ;     /* cpu of each stage, -1 : any */
+    int demod_threads ;                 /* threads sharing each block in the demod stage */
+    int sample_rate ;                   /* SAMPLE_RATE or SAMPLE_RATE_2400 */
+    int gain_mode ;                     /* GAIN_xxx */
+    int gain ;                          /* tenth of dB, GAIN_FIXED only */
+    ModeSDecoder *decoder ;
+    int update_interval ;
+    int output_format ;
+    BinaryUpdateQueue *binary ;
+    int batch_updates ;     /* 1 : one mailbox message per update */
+    int batch_latency ;     /* ms */
+    UpdateFilter *filter ;  /* owned by decode_thread while running */
+    std::atomic<UpdateFilter *> new_filter ;    /* set by setFilter(), taken by decode_thread */
+    TCPFeedServer *beast ;  /* Beast binary frames, when started */
+    TCPFeedServer *sbs ;    /* SBS-1 BaseStation lines, when started */
+    TCPFeedServer *avr ;    /* AVR text frames, when started */
+    int avr_format ;
+    ShmUpdateRing *shm ;    /* shared memory output, when open */
+    MulticastPublisher *multicast ;
+    WebSocketServer *websocket ;    /* live feed for browser maps, when started */
 } ADSBThreadParams  ;
 
 class ADSBPlugin : public IJSClass
@@ -37,6 +133,7 @@ class ADSBPlugin : public IJSClass
 public:
 
     ADSBPlugin() = default;
+    ~ADSBPlugin();
 
     const char* Name() ;
     const char* JSTypeName() ;
@@ -49,13 +146,36 @@ public:
     bool isRunning();
     void stop();
 
-    bool start( char *rtlsdr_serial_number );
+    bool start( char *rtlsdr_serial_numbers, int sample_rate = SAMPLE_RATE );
+
+    ModeSDecoder *decoder();
+    void setUpdateInterval( int ms );
+    bool setOutputFormat( const char *format );
+    void setBatching( int max_updates, int max_latency );
+    BinaryUpdateQueue *binaryQueue();
+    bool setFilter( const char *spec );
+    TCPFeedServer *beastServer();
+    TCPFeedServer *sbsServer();
+    TCPFeedServer *avrServer();
+    bool setAVRFormat( const char *format );
+    AircraftJSONWriter *jsonWriter();
+    ShmUpdateRing *sharedMemory();
+    MulticastPublisher *multicast();
+    WebSocketServer *websocketServer();
+    bool setAffinity( const char *stage, int cpu );
+    void getPipelineStats( PipelineStats *stats );
+    int getReceiverStats( ReceiverStats *stats );
+    bool setDemodThreads( int threads );
+    bool setGain( const char *gain );
 
 private:
      TMBox *box ;
-     std::thread *adsb ;
+     std::thread *adsb = nullptr ;
 
      ADSBThreadParams params ;
+     AircraftJSONWriter *json_writer = nullptr ;   /* null until init() */
+
+     void closeDevices();
 };
 
 #endif // EXAMPLEPLUGIN_H
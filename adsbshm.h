@@ -0,0 +1,138 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef ADSBSHM_H
+#define ADSBSHM_H
+
+/* Shared memory ring of ADSBBinaryUpdate records, written by the plugin
+ * and read by any number of processes on the same host. Plain C, needs
+ * GCC or clang for the __atomic builtins.
+ *
+ * The plugin is the only writer. Record number 'n' goes to slot
+ * n % capacity ; the slot sequence is 2n+1 while it is written and 2n+2
+ * once complete, then the header 'head' moves to n+1. A reader keeps its
+ * own position, nothing is shared between readers, and a reader too slow
+ * to keep up skips the overwritten records and counts them as lost.
+ *
+ * usage :
+ *   ADSBShmReader r ;
+ *   if( adsb_shm_open( &r, ADSB_SHM_DEFAULT_NAME ) == 0 ) {
+ *       ADSBBinaryUpdate updates[256] ;
+ *       for( ;; ) {
+ *           int n = adsb_shm_read( &r, updates, 256 );
+ *           ...
+ *       }
+ *   }
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "adsbbinary.h"
+
+#define ADSB_SHM_DEFAULT_NAME "/adsb_updates"
+#define ADSB_SHM_MAGIC 0x42534441       /* "ADSB" */
+#define ADSB_SHM_VERSION 2
+#define ADSB_SHM_DEFAULT_CAPACITY 65536 /* slots, a power of two */
+
+typedef struct {
+    uint32_t magic ;
+    uint32_t version ;
+    uint32_t capacity ;         /* slots */
+    uint32_t slot_size ;        /* sizeof(ADSBShmSlot) */
+    uint8_t  pad[48] ;
+    uint64_t head ;             /* number of records written so far */
+    uint8_t  pad2[56] ;
+} ADSBShmHeader ;
+
+typedef struct {
+    uint64_t seq ;
+    ADSBBinaryUpdate rec ;
+    uint8_t  pad[64 - 8 - sizeof(ADSBBinaryUpdate)] ;
+} ADSBShmSlot ;
+
+#define ADSB_SHM_SIZE(capacity) (sizeof(ADSBShmHeader) + (size_t)(capacity) * sizeof(ADSBShmSlot))
+
+typedef struct {
+    const ADSBShmHeader *header ;
+    const ADSBShmSlot *slots ;
+    size_t size ;
+    uint64_t next ;             /* next record to read */
+    uint64_t lost ;             /* records overwritten before being read */
+} ADSBShmReader ;
+
+/* returns 0 on success, starting with the records written from now on */
+static inline int adsb_shm_open( ADSBShmReader *r, const char *name ) {
+    struct stat st ;
+    int fd = shm_open( name, O_RDONLY, 0 );
+    if( fd < 0 )
+        return( -1 );
+    if( (fstat( fd, &st ) < 0) || ((size_t)st.st_size < sizeof(ADSBShmHeader)) ) {
+        close( fd );
+        return( -1 );
+    }
+    void *p = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( p == MAP_FAILED )
+        return( -1 );
+    r->header = (const ADSBShmHeader *)p ;
+    r->slots = (const ADSBShmSlot *)(r->header + 1) ;
+    r->size = st.st_size ;
+    if( (r->header->magic != ADSB_SHM_MAGIC) || (r->header->version != ADSB_SHM_VERSION) ||
+        (r->header->slot_size != sizeof(ADSBShmSlot)) ||
+        (ADSB_SHM_SIZE(r->header->capacity) > r->size) ) {
+        munmap( p, r->size );
+        return( -1 );
+    }
+    r->next = __atomic_load_n( &r->header->head, __ATOMIC_ACQUIRE );
+    r->lost = 0 ;
+    return( 0 );
+}
+
+static inline void adsb_shm_close( ADSBShmReader *r ) {
+    munmap( (void *)r->header, r->size );
+}
+
+/* copies up to max records, oldest first, never blocks */
+static inline int adsb_shm_read( ADSBShmReader *r, ADSBBinaryUpdate *out, int max ) {
+    uint64_t capacity = r->header->capacity ;
+    int n = 0 ;
+    while( n < max ) {
+        uint64_t head = __atomic_load_n( &r->header->head, __ATOMIC_ACQUIRE );
+        if( r->next >= head )
+            break ;
+        if( head - r->next > capacity ) {
+            r->lost += head - capacity - r->next ;
+            r->next = head - capacity ;
+        }
+        const ADSBShmSlot *slot = &r->slots[r->next & (capacity - 1)] ;
+        uint64_t expected = 2 * r->next + 2 ;
+        if( __atomic_load_n( &slot->seq, __ATOMIC_ACQUIRE ) != expected ) {
+            r->next++ ;         /* being overwritten */
+            r->lost++ ;
+            continue ;
+        }
+        memcpy( &out[n], &slot->rec, sizeof(ADSBBinaryUpdate) );
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+        if( __atomic_load_n( &slot->seq, __ATOMIC_RELAXED ) != expected ) {
+            r->next++ ;
+            r->lost++ ;
+            continue ;
+        }
+        r->next++ ;
+        n++ ;
+    }
+    return( n );
+}
+
+#endif // ADSBSHM_H
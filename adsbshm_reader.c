@@ -0,0 +1,64 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+/* Example reader of the shared memory ring, see adsbshm.h. Prints the
+ * updates, or with -b only the record rate and the lost count.
+ *
+ *   gcc -O2 -o adsbshm_reader adsbshm_reader.c -lrt
+ *   ./adsbshm_reader [-b] [/adsb_updates]
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "adsbshm.h"
+
+#define READ_MAX 1024
+
+int main( int argc, char **argv ) {
+    const char *name = ADSB_SHM_DEFAULT_NAME ;
+    int bench = 0 ;
+    for( int i = 1 ; i < argc ; i++ ) {
+        if( strcmp( argv[i], "-b" ) == 0 )
+            bench = 1 ;
+        else
+            name = argv[i] ;
+    }
+
+    ADSBShmReader r ;
+    if( adsb_shm_open( &r, name ) != 0 ) {
+        fprintf( stderr, "Cannot open shared memory %s\n", name );
+        return( 1 );
+    }
+
+    static ADSBBinaryUpdate updates[READ_MAX] ;
+    uint64_t total = 0 ;
+    time_t last = time( NULL );
+    for( ;; ) {
+        int n = adsb_shm_read( &r, updates, READ_MAX );
+        if( n == 0 ) {
+            usleep( 1000 );
+        }
+        total += n ;
+        if( !bench ) {
+            for( int i = 0 ; i < n ; i++ ) {
+                ADSBBinaryUpdate *u = &updates[i] ;
+                printf( "%06x type %d alt %d lat %.5f lon %.5f %.8s\n", u->icao, u->update_type,
+                        u->altitude, u->lat / 1e7, u->lon / 1e7, u->flight );
+            }
+        } else if( time( NULL ) != last ) {
+            last = time( NULL );
+            printf( "%llu records/s, %llu lost\n", (unsigned long long)total, (unsigned long long)r.lost );
+            total = 0 ;
+        }
+    }
+    return( 0 );
+}
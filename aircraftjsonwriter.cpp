@@ -0,0 +1,163 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "aircraftjsonwriter.h"
+#include "aircraftsnapshot.h"
+#include "jsonwriter.h"
+
+#define AIRCRAFT_FILE_HEADER 128        /* "now", "messages" and the brackets */
+
+static const char *emergency_names[8] = {
+    "none", "general", "lifeguard", "minfuel", "nordo", "unlawful", "downed", "reserved"
+};
+
+// seconds, with the 0.1 s resolution dump1090 uses
+static double age( uint64_t now, uint64_t t ) {
+    return( now > t ? round( (now - t) / 100.0 ) / 10.0 : 0.0 );
+}
+
+static void writeAircraft( JSONWriter& w, const AircraftState *ac, uint64_t now ) {
+    char hex[8] ;
+    snprintf( hex, sizeof(hex), "%06x", ac->addr & 0xffffff );
+
+    w.beginObject();
+    w.key("hex");                w.value( hex );
+    if( ac->flight[0] ) {
+        w.key("flight");         w.value( ac->flight );
+    }
+    if( ac->altitude ) {
+        w.key("alt_baro");       w.value( ac->altitude );
+    }
+    if( ac->speed ) {
+        w.key("gs");             w.value( ac->speed );
+        w.key("track");          w.value( ac->track );
+    }
+    if( ac->vert_rate > 0 ) {
+        // 64 fpm steps, 0 means no information
+        int rate = (ac->vert_rate - 1) * 64 ;
+        w.key("baro_rate");      w.value( ac->vert_rate_sign ? -rate : rate );
+    }
+    if( ac->squawk ) {
+        char squawk[8] ;
+        snprintf( squawk, sizeof(squawk), "%04d", ac->squawk );
+        w.key("squawk");         w.value( squawk );
+    }
+    w.key("emergency");          w.value( emergency_names[ac->emergency & 7] );
+    if( ac->position_valid ) {
+        w.key("lat");            w.value( ac->lat );
+        w.key("lon");            w.value( ac->lon );
+        w.key("seen_pos");       w.value( age( now, ac->position_time ));
+    }
+    w.key("messages");           w.value( (int64_t)ac->messages );
+    w.key("seen");               w.value( age( now, ac->seen ));
+    w.key("rssi");               w.value( ac->rssi );
+    w.endObject();
+}
+
+AircraftJSONWriter::AircraftJSONWriter( ModeSDecoder *decoder ) {
+    this->decoder = decoder ;
+    interval = DEFAULT_JSON_INTERVAL ;
+    writer = nullptr ;
+    stopping = false ;
+    int capacity = decoder->snapshot()->capacity() ;
+    table = (AircraftState *)malloc( capacity * sizeof(AircraftState));
+    text_size = AIRCRAFT_FILE_HEADER + capacity * AIRCRAFT_JSON_MAXLEN ;
+    text = (char *)malloc( text_size );
+}
+
+AircraftJSONWriter::~AircraftJSONWriter() {
+    stop();
+    free( table );
+    free( text );
+}
+
+bool AircraftJSONWriter::start( const char *path, int interval_ms ) {
+    stop();
+    if( (path == nullptr) || (path[0] == 0) || (interval_ms <= 0) )
+        return( false );
+    this->path = path ;
+    tmp_path = this->path + ".tmp" ;
+    interval = interval_ms ;
+    // fail now rather than in the background if the directory is not writable
+    if( !writeFile() )
+        return( false );
+    stopping = false ;
+    writer = new std::thread( writerThread, this );
+    return( true );
+}
+
+void AircraftJSONWriter::stop() {
+    if( writer == nullptr )
+        return ;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true ;
+    }
+    wakeup.notify_all();
+    writer->join();
+    delete writer ;
+    writer = nullptr ;
+}
+
+bool AircraftJSONWriter::isRunning() {
+    return( writer != nullptr );
+}
+
+void AircraftJSONWriter::writerThread( AircraftJSONWriter *w ) {
+    w->run();
+}
+
+void AircraftJSONWriter::run() {
+    std::unique_lock<std::mutex> guard(lock);
+    while( !stopping ) {
+        wakeup.wait_for( guard, std::chrono::milliseconds(interval), [this]() {
+            return( stopping );
+        });
+        if( stopping )
+            break ;
+        guard.unlock();
+        writeFile();
+        guard.lock();
+    }
+}
+
+bool AircraftJSONWriter::writeFile() {
+    AircraftSnapshot *snapshot = decoder->snapshot() ;
+    int n = snapshot->read( table, snapshot->capacity(), nullptr );
+    ModeSStats stats ;
+    decoder->getStats( &stats );
+    uint64_t now = getTimeStamp();
+
+    JSONWriter w( text, text_size );
+    w.beginObject();
+    w.key("now");        w.value( now / 1000.0 );
+    w.key("messages");   w.value( stats.messages );
+    w.key("aircraft");
+    w.beginArray();
+    for( int i = 0 ; i < n ; i++ ) {
+        writeAircraft( w, &table[i], now );
+    }
+    w.endArray();
+    w.endObject();
+
+    FILE *f = fopen( tmp_path.c_str(), "w" );
+    if( f == nullptr )
+        return( false );
+    bool ok = fwrite( w.data(), 1, w.length(), f ) == w.length() ;
+    ok = (fclose( f ) == 0) && ok ;
+    if( !ok || (rename( tmp_path.c_str(), path.c_str()) != 0) ) {
+        remove( tmp_path.c_str() );
+        return( false );
+    }
+    return( true );
+}
@@ -0,0 +1,61 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef AIRCRAFTJSONWRITER_H
+#define AIRCRAFTJSONWRITER_H
+
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include "modesdecoder.h"
+
+#define DEFAULT_JSON_INTERVAL 1000      /* ms between two aircraft.json files */
+
+/* AircraftJSONWriter : background thread writing the aircraft table as a
+ * dump1090 style aircraft.json every 'interval' ms, for web maps such as
+ * tar1090.
+ *
+ * The table comes from the decoder snapshot, so the decoder is never
+ * blocked. Each file is written under a temporary name and renamed over
+ * the previous one : readers always see a complete file.
+ */
+class AircraftJSONWriter
+{
+public:
+    AircraftJSONWriter( ModeSDecoder *decoder );
+    ~AircraftJSONWriter();
+
+    bool start( const char *path, int interval_ms );
+    void stop();
+    bool isRunning();
+
+private:
+    ModeSDecoder *decoder ;
+    std::string path ;
+    std::string tmp_path ;
+    int interval ;
+
+    std::thread *writer ;
+    std::mutex lock ;
+    std::condition_variable wakeup ;
+    bool stopping ;
+
+    AircraftState *table ;
+    char *text ;
+    size_t text_size ;
+
+    static void writerThread( AircraftJSONWriter *w );
+    void run();
+    bool writeFile();
+};
+
+#endif // AIRCRAFTJSONWRITER_H
@@ -0,0 +1,121 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "aircraftsnapshot.h"
+
+// JSON description of one aircraft, as returned by getAircraft / listAircraft
+void writeAircraftState( JSONWriter& w, const AircraftState *ac, uint64_t now ) {
+    char hex[8] ;
+    snprintf( hex, sizeof(hex), "%06x", ac->addr & 0xffffff );
+
+    w.beginObject();
+    w.key("altitude");       w.value( ac->altitude );
+    w.key("emergency");      w.value( ac->emergency );
+    w.key("flight");         w.value( ac->flight );
+    w.key("hex");            w.value( hex );
+    w.key("icao");           w.value( ac->addr );
+    if( ac->position_valid ) {
+        w.key("lat");        w.value( ac->lat );
+        w.key("lon");        w.value( ac->lon );
+    }
+    w.key("messages");       w.value( (int64_t)ac->messages );
+    w.key("position_valid"); w.value( ac->position_valid );
+    w.key("rssi");           w.value( ac->rssi );
+    w.key("seen");           w.value( now > ac->seen ? (now - ac->seen) / 1000.0 : 0.0 );
+    w.key("speed");          w.value( ac->speed );
+    w.key("squawk");         w.value( ac->squawk );
+    w.key("track");          w.value( ac->track );
+    w.key("vert_rate");      w.value( ac->vert_rate );
+    w.key("vert_rate_sign"); w.value( ac->vert_rate_sign );
+    w.endObject();
+}
+
+AircraftSnapshot::AircraftSnapshot( int capacity ) {
+    size = capacity ;
+    for( int i = 0 ; i < 2 ; i++ ) {
+        buffers[i].seq = 0 ;
+        buffers[i].count = 0 ;
+        buffers[i].time = 0 ;
+        buffers[i].table = (AircraftState *)malloc( size * sizeof(AircraftState));
+    }
+    current = 0 ;
+}
+
+AircraftSnapshot::~AircraftSnapshot() {
+    free( buffers[0].table );
+    free( buffers[1].table );
+}
+
+int AircraftSnapshot::capacity() const {
+    return( size );
+}
+
+// returns the table to fill, nobody reads it until endUpdate()
+AircraftState *AircraftSnapshot::beginUpdate() {
+    SnapshotBuffer& b = buffers[ 1 - current.load(std::memory_order_relaxed) ] ;
+    b.seq.fetch_add( 1, std::memory_order_relaxed );     // odd : being written
+    std::atomic_thread_fence( std::memory_order_release );
+    return( b.table );
+}
+
+void AircraftSnapshot::endUpdate( int count, uint64_t now ) {
+    int next = 1 - current.load(std::memory_order_relaxed) ;
+    SnapshotBuffer& b = buffers[next] ;
+    b.count.store( count, std::memory_order_relaxed );
+    b.time.store( now, std::memory_order_relaxed );
+    b.seq.fetch_add( 1, std::memory_order_release );     // even : stable
+    current.store( next, std::memory_order_release );
+}
+
+// copy the current table, returns the number of aircraft copied
+int AircraftSnapshot::read( AircraftState *out, int max_aircraft, uint64_t *time ) {
+    for( ;; ) {
+        SnapshotBuffer& b = buffers[ current.load(std::memory_order_acquire) ] ;
+        uint32_t seq = b.seq.load( std::memory_order_acquire );
+        if( seq & 1 )
+            continue ;
+        int n = b.count.load( std::memory_order_relaxed );
+        if( n > max_aircraft )
+            n = max_aircraft ;
+        memcpy( out, b.table, n * sizeof(AircraftState));
+        if( time != nullptr )
+            *time = b.time.load( std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if( b.seq.load( std::memory_order_relaxed ) == seq )
+            return( n );
+    }
+}
+
+bool AircraftSnapshot::find( uint32_t addr, AircraftState *out ) {
+    for( ;; ) {
+        SnapshotBuffer& b = buffers[ current.load(std::memory_order_acquire) ] ;
+        uint32_t seq = b.seq.load( std::memory_order_acquire );
+        if( seq & 1 )
+            continue ;
+        bool found = false ;
+        int n = b.count.load( std::memory_order_relaxed );
+        for( int i = 0 ; i < n ; i++ ) {
+            if( b.table[i].addr == addr ) {
+                memcpy( out, &b.table[i], sizeof(AircraftState));
+                found = true ;
+                break ;
+            }
+        }
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if( b.seq.load( std::memory_order_relaxed ) == seq )
+            return( found );
+    }
+}
+
+int AircraftSnapshot::count() {
+    return( buffers[ current.load(std::memory_order_acquire) ].count.load(std::memory_order_relaxed) );
+}
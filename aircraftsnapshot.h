@@ -0,0 +1,63 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef AIRCRAFTSNAPSHOT_H
+#define AIRCRAFTSNAPSHOT_H
+
+#include <stdint.h>
+#include <atomic>
+#include "jsonwriter.h"
+#include "modesdecoder.h"
+
+#define SNAPSHOT_MAX_AIRCRAFT 1024
+#define SNAPSHOT_INTERVAL 250           /* ms between two snapshots */
+#define AIRCRAFT_JSON_MAXLEN 384        /* Longest JSON text of one aircraft */
+
+void writeAircraftState( JSONWriter& w, const AircraftState *ac, uint64_t now );
+
+/* AircraftSnapshot : copy of the aircraft table that other threads can read
+ * without ever blocking the decoder.
+ *
+ * The decoder thread is the only writer : it fills the spare one of two
+ * buffers and then makes it current. Each buffer has a sequence number,
+ * odd while being written, so a reader copies the current buffer and
+ * starts again only if it was overwritten meanwhile, which needs the
+ * copy to last longer than a whole snapshot interval.
+ */
+class AircraftSnapshot
+{
+public:
+    AircraftSnapshot( int capacity = SNAPSHOT_MAX_AIRCRAFT );
+    ~AircraftSnapshot();
+
+    // writer side, decoder thread only
+    AircraftState *beginUpdate();
+    void endUpdate( int count, uint64_t now );
+    int capacity() const ;
+
+    // reader side, any thread
+    int read( AircraftState *out, int max_aircraft, uint64_t *time );
+    bool find( uint32_t addr, AircraftState *out );
+    int count();
+
+private:
+    typedef struct {
+        std::atomic<uint32_t> seq ;
+        std::atomic<int> count ;
+        std::atomic<uint64_t> time ;
+        AircraftState *table ;
+    } SnapshotBuffer ;
+
+    SnapshotBuffer buffers[2] ;
+    std::atomic<int> current ;
+    int size ;
+};
+
+#endif // AIRCRAFTSNAPSHOT_H
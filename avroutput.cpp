@@ -0,0 +1,59 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <string.h>
+#include "avroutput.h"
+
+static const char hex[] = "0123456789ABCDEF" ;
+
+static inline char *putHex( char *p, uint64_t x, int digits ) {
+    for( int shift = (digits - 1) * 4 ; shift >= 0 ; shift -= 4 ) {
+        *p++ = hex[(x >> shift) & 15] ;
+    }
+    return( p );
+}
+
+size_t encodeAVRFrame( char *out, const ADSBRawMSG *msg, int format ) {
+    int bytes = (msg->len - 1) / 8 ;
+    char *p = out ;
+
+    switch( format ) {
+    case AVR_FORMAT_TIMESTAMP:
+        *p++ = '@' ;
+        p = putHex( p, msg->timestamp, 12 );
+        break ;
+    case AVR_FORMAT_RSSI:
+        *p++ = '<' ;
+        p = putHex( p, msg->timestamp, 12 );
+        p = putHex( p, msg->signal, 2 );
+        break ;
+    default:
+        *p++ = '*' ;
+        break ;
+    }
+    for( int i = 0 ; i < bytes ; i++ ) {
+        p = putHex( p, msg->msg[i], 2 );
+    }
+    *p++ = ';' ;
+    *p++ = '\n' ;
+    *p = 0 ;
+    return( (size_t)(p - out) );
+}
+
+// -1 if the name is unknown
+int avrFormatByName( const char *name ) {
+    if( strcmp( name, "plain" ) == 0 )
+        return( AVR_FORMAT_PLAIN );
+    if( strcmp( name, "timestamp" ) == 0 )
+        return( AVR_FORMAT_TIMESTAMP );
+    if( strcmp( name, "rssi" ) == 0 )
+        return( AVR_FORMAT_RSSI );
+    return( -1 );
+}
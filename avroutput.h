@@ -0,0 +1,33 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef AVROUTPUT_H
+#define AVROUTPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "adsbframer.h"
+
+#define AVR_FORMAT_PLAIN 0      /* *8D4840D6202CC371C32CE0576098; */
+#define AVR_FORMAT_TIMESTAMP 1  /* @0000002EE0008D4840D6202CC371C32CE0576098; */
+#define AVR_FORMAT_RSSI 2       /* <0000002EE0008D8D4840D6202CC371C32CE0576098; */
+
+#define AVR_FRAME_MAXLEN (1 + 12 + 2 + 28 + 3)  /* longest line, newline and NUL included */
+#define DEFAULT_AVR_PORT 30002
+
+/* AVR text frame, the message in hex : plain, prefixed with the 48 bits
+ * 12 MHz timestamp, or with the timestamp and the signal level. Writes a
+ * ";\n" terminated line followed by a NUL, returns its length without the
+ * NUL.
+ */
+size_t encodeAVRFrame( char *out, const ADSBRawMSG *msg, int format );
+int avrFormatByName( const char *name );
+
+#endif // AVROUTPUT_H
@@ -0,0 +1,34 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include "beastoutput.h"
+
+static inline uint8_t *beastByte( uint8_t *p, uint8_t b ) {
+    *p++ = b ;
+    if( b == BEAST_ESCAPE )
+        *p++ = b ;
+    return( p );
+}
+
+size_t encodeBeastFrame( uint8_t *out, const ADSBRawMSG *msg ) {
+    int bytes = (msg->len - 1) / 8 ;
+    uint8_t *p = out ;
+
+    *p++ = BEAST_ESCAPE ;
+    *p++ = bytes == 7 ? BEAST_TYPE_SHORT : BEAST_TYPE_LONG ;
+    for( int shift = 40 ; shift >= 0 ; shift -= 8 ) {
+        p = beastByte( p, (uint8_t)(msg->timestamp >> shift) );
+    }
+    p = beastByte( p, msg->signal );
+    for( int i = 0 ; i < bytes ; i++ ) {
+        p = beastByte( p, msg->msg[i] );
+    }
+    return( (size_t)(p - out) );
+}
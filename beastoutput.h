@@ -0,0 +1,30 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef BEASTOUTPUT_H
+#define BEASTOUTPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "adsbframer.h"
+
+#define BEAST_ESCAPE 0x1a
+#define BEAST_TYPE_SHORT '2'    /* 56 bits Mode S frame */
+#define BEAST_TYPE_LONG  '3'    /* 112 bits Mode S frame */
+#define BEAST_FRAME_MAXLEN (2 + 2*(6 + 1 + 14))  /* every byte after the type escaped */
+#define DEFAULT_BEAST_PORT 30005
+
+/* Mode-S Beast binary frame : 0x1a, type, 48 bits big endian 12 MHz
+ * timestamp, signal level, message. Any 0x1a after the type is doubled.
+ * Returns the number of bytes written to out.
+ */
+size_t encodeBeastFrame( uint8_t *out, const ADSBRawMSG *msg );
+
+#endif // BEASTOUTPUT_H
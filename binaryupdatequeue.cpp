@@ -0,0 +1,89 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "binaryupdatequeue.h"
+
+static_assert( sizeof(ADSBBinaryUpdate) == 38, "adsb_binary.js expects 38 byte records" );
+
+void encodeBinaryUpdate( ADSBBinaryUpdate *rec, ADSBUpdate *msg ) {
+    AircraftState *ac = &msg->state ;
+
+    memset( rec, 0, sizeof(ADSBBinaryUpdate));
+    rec->icao = msg->addr ;
+    rec->update_type = msg->update_type ;
+    rec->changes = msg->changes ;
+    if( msg->update_type == ADSBUPDATE_TYPE_AIRCRAFTLOST )
+        return ;
+
+    if( ac->position_valid ) {
+        rec->flags |= ADSB_BINARY_FLAG_POSITION_VALID ;
+        rec->lat = (int32_t)lround( ac->lat * 1e7 );
+        rec->lon = (int32_t)lround( ac->lon * 1e7 );
+    }
+    rec->flags |= (ac->emergency << ADSB_BINARY_EMERGENCY_SHIFT) & ADSB_BINARY_EMERGENCY_MASK ;
+    rec->altitude = ac->altitude ;
+    rec->speed = (uint16_t)ac->speed ;
+    rec->track = (uint16_t)ac->track ;
+    if( ac->vert_rate > 0 ) {
+        // 64 fpm steps, 0 means no information
+        int rate = (ac->vert_rate - 1) * 64 ;
+        rec->vert_rate = (int16_t)(ac->vert_rate_sign ? -rate : rate) ;
+    }
+    rec->squawk = (uint16_t)ac->squawk ;
+    memset( rec->flight, ' ', sizeof(rec->flight));
+    for( int i = 0 ; (i < (int)sizeof(rec->flight)) && ac->flight[i] ; i++ ) {
+        rec->flight[i] = ac->flight[i] ;
+    }
+    rec->rssi = (int16_t)lround( ac->rssi * 10 );
+}
+
+BinaryUpdateQueue::BinaryUpdateQueue( int capacity ) {
+    this->capacity = capacity ;
+    ring = (ADSBBinaryUpdate *)malloc( capacity * sizeof(ADSBBinaryUpdate));
+    head = 0 ;
+    count = 0 ;
+    drop_count = 0 ;
+}
+
+BinaryUpdateQueue::~BinaryUpdateQueue() {
+    free( ring );
+}
+
+void BinaryUpdateQueue::push( ADSBUpdate *msg ) {
+    std::lock_guard<std::mutex> guard(lock);
+    if( count == capacity ) {
+        // overwrite the oldest record
+        head = (head + 1) % capacity ;
+        count-- ;
+        drop_count++ ;
+    }
+    encodeBinaryUpdate( &ring[(head + count) % capacity], msg );
+    count++ ;
+}
+
+// copy up to max_records records, oldest first
+int BinaryUpdateQueue::pop( ADSBBinaryUpdate *out, int max_records ) {
+    std::lock_guard<std::mutex> guard(lock);
+    int n = count < max_records ? count : max_records ;
+    for( int i = 0 ; i < n ; i++ ) {
+        out[i] = ring[head] ;
+        head = (head + 1) % capacity ;
+    }
+    count -= n ;
+    return( n );
+}
+
+uint64_t BinaryUpdateQueue::dropped() {
+    std::lock_guard<std::mutex> guard(lock);
+    return( drop_count );
+}
@@ -0,0 +1,45 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef BINARYUPDATEQUEUE_H
+#define BINARYUPDATEQUEUE_H
+
+#include <mutex>
+#include "adsbbinary.h"
+#include "modesdecoder.h"
+
+#define BINARY_QUEUE_LEN 65536     /* records, about 2.3 MiB */
+
+void encodeBinaryUpdate( ADSBBinaryUpdate *rec, ADSBUpdate *msg );
+
+/* BinaryUpdateQueue : bounded ring of binary records filled by the ADSB
+ * thread and drained by JS with readUpdates(). When the reader is too
+ * slow the oldest records are overwritten and counted as dropped.
+ */
+class BinaryUpdateQueue
+{
+public:
+    BinaryUpdateQueue( int capacity = BINARY_QUEUE_LEN );
+    ~BinaryUpdateQueue();
+
+    void push( ADSBUpdate *msg );
+    int pop( ADSBBinaryUpdate *out, int max_records );
+    uint64_t dropped();
+
+private:
+    std::mutex lock ;
+    ADSBBinaryUpdate *ring ;
+    int capacity ;
+    int head ;      /* next record to read */
+    int count ;
+    uint64_t drop_count ;
+};
+
+#endif // BINARYUPDATEQUEUE_H
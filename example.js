@@ -12,6 +12,8 @@ if( ok == false ) {
 }
 
 var adsb = new ADSB();
+// post the updates by arrays of up to 100, at most 50 ms late
+adsb.setBatching( 100, 50 );
 if( adsb.start() == false ) {
     print('Could not start ADSB');
     exit();
@@ -19,6 +21,8 @@ if( adsb.start() == false ) {
 
 for( ;; ) {
     var msg = MBoxPopWait('ADSBMESSAGES', 1000 ) ;
-    
-    print( JSON.stringify(msg));
+    var updates = Array.isArray(msg) ? msg : [msg] ;
+    for( var i = 0 ; i < updates.length ; i++ ) {
+        print( JSON.stringify(updates[i]));
+    }
 }
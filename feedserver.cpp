@@ -0,0 +1,387 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "feedserver.h"
+
+#define FEED_MAX_EVENTS 64
+#define FEED_MAX_IOV 16
+
+TCPFeedServer::TCPFeedServer( int max_clients ) {
+    this->max_clients = max_clients ;
+    running = false ;
+    server = nullptr ;
+    listen_fd = -1 ;
+    epoll_fd = -1 ;
+    pending = nullptr ;
+    chunks = new SPSCQueue<FeedChunk *>( FEED_MAX_CHUNKS );
+    // kept open for the whole life of the server : the producer may still
+    // signal it while stop() runs
+    event_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    client_count = 0 ;
+    dropped_clients = 0 ;
+    dropped_chunks = 0 ;
+}
+
+TCPFeedServer::~TCPFeedServer() {
+    stop();
+    if( pending != nullptr )
+        releaseChunk( pending );
+    delete chunks ;
+    if( event_fd >= 0 ) close( event_fd );
+}
+
+bool TCPFeedServer::start( int port ) {
+    if( running )
+        return( false );
+
+    listen_fd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    if( listen_fd < 0 )
+        return( false );
+    int on = 1 ;
+    setsockopt( listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on) );
+
+    struct sockaddr_in addr ;
+    memset( &addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET ;
+    addr.sin_addr.s_addr = htonl( INADDR_ANY );
+    addr.sin_port = htons( (uint16_t)port );
+    if( (bind( listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+        (listen( listen_fd, 128 ) < 0) ) {
+        close( listen_fd );
+        listen_fd = -1 ;
+        return( false );
+    }
+
+    epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+    if( (epoll_fd < 0) || (event_fd < 0) ) {
+        stop();
+        return( false );
+    }
+    struct epoll_event ev ;
+    memset( &ev, 0, sizeof(ev));
+    ev.events = EPOLLIN ;
+    ev.data.ptr = &listen_fd ;
+    epoll_ctl( epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev );
+    ev.data.ptr = &event_fd ;
+    epoll_ctl( epoll_fd, EPOLL_CTL_ADD, event_fd, &ev );
+
+    running = true ;
+    server = new std::thread( serverThread, this );
+    return( true );
+}
+
+void TCPFeedServer::stop() {
+    if( server != nullptr ) {
+        running = false ;
+        uint64_t one = 1 ;
+        if( ::write( event_fd, &one, sizeof(one)) < 0 ) {
+            // the thread will still see 'running' at its next timeout
+        }
+        server->join();
+        delete server ;
+        server = nullptr ;
+    }
+    running = false ;
+    for( FeedClient *c : clients ) {
+        if( c->fd >= 0 )
+            closeClient( c );
+        delete c ;
+    }
+    clients.clear();
+    client_count = 0 ;
+
+    FeedChunk *chunk ;
+    while( chunks->pop( chunk )) {
+        releaseChunk( chunk );
+    }
+    if( listen_fd >= 0 ) close( listen_fd );
+    if( epoll_fd >= 0 ) close( epoll_fd );
+    listen_fd = epoll_fd = -1 ;
+}
+
+bool TCPFeedServer::isRunning() {
+    return( running );
+}
+
+int TCPFeedServer::clientCount() {
+    return( client_count );
+}
+
+uint64_t TCPFeedServer::droppedClients() {
+    return( dropped_clients );
+}
+
+uint64_t TCPFeedServer::droppedChunks() {
+    return( dropped_chunks );
+}
+
+FeedChunk *TCPFeedServer::newChunk( size_t size ) {
+    FeedChunk *chunk = (FeedChunk *)malloc( sizeof(FeedChunk) + size );
+    chunk->refs = 1 ;
+    chunk->len = 0 ;
+    chunk->data = (uint8_t *)(chunk + 1) ;
+    return( chunk );
+}
+
+void TCPFeedServer::releaseChunk( FeedChunk *chunk ) {
+    if( --chunk->refs == 0 )
+        free( chunk );
+}
+
+// producer side : gather the output of one block in the pending chunk
+void TCPFeedServer::write( const void *data, size_t len ) {
+    if( !running )
+        return ;
+    if( (pending != nullptr) && (pending->len + len > FEED_CHUNK_SIZE) )
+        publish();
+    if( pending == nullptr )
+        pending = newChunk( len > FEED_CHUNK_SIZE ? len : FEED_CHUNK_SIZE );
+    memcpy( pending->data + pending->len, data, len );
+    pending->len += len ;
+}
+
+void TCPFeedServer::publish() {
+    if( (pending == nullptr) || (pending->len == 0) )
+        return ;
+    if( !running || !chunks->push( pending )) {
+        releaseChunk( pending );
+        dropped_chunks++ ;
+    }
+    pending = nullptr ;
+    uint64_t one = 1 ;
+    if( ::write( event_fd, &one, sizeof(one)) < 0 ) {
+        // counter overflow, the server thread is already awake
+    }
+}
+
+void TCPFeedServer::serverThread( TCPFeedServer *s ) {
+    s->run();
+}
+
+void TCPFeedServer::run() {
+    struct epoll_event events[FEED_MAX_EVENTS] ;
+    while( running ) {
+        int n = epoll_wait( epoll_fd, events, FEED_MAX_EVENTS, 1000 );
+        for( int i = 0 ; i < n ; i++ ) {
+            void *ptr = events[i].data.ptr ;
+            if( ptr == &listen_fd ) {
+                acceptClients();
+            } else if( ptr == &event_fd ) {
+                uint64_t count ;
+                if( read( event_fd, &count, sizeof(count)) < 0 ) {
+                    // spurious wakeup
+                }
+                FeedChunk *chunk ;
+                while( chunks->pop( chunk )) {
+                    broadcast( chunk );
+                }
+            } else {
+                FeedClient *c = (FeedClient *)ptr ;
+                if( c->fd < 0 )
+                    continue ;
+                if( events[i].events & (EPOLLERR | EPOLLHUP) ) {
+                    closeClient( c );
+                    continue ;
+                }
+                if( events[i].events & EPOLLIN )
+                    readClient( c );
+                if( (c->fd >= 0) && (events[i].events & EPOLLOUT) )
+                    flushClient( c );
+            }
+        }
+        removeClosed();
+    }
+}
+
+void TCPFeedServer::acceptClients() {
+    for( ;; ) {
+        int fd = accept4( listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC );
+        if( fd < 0 )
+            return ;
+        if( (int)clients.size() >= max_clients ) {
+            close( fd );
+            continue ;
+        }
+        int on = 1 ;
+        setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        FeedClient *c = new FeedClient ;
+        c->fd = fd ;
+        c->ready = true ;
+        c->offset = 0 ;
+        c->queued = 0 ;
+        c->writing = false ;
+        c->ctx = nullptr ;
+        struct epoll_event ev ;
+        memset( &ev, 0, sizeof(ev));
+        ev.events = EPOLLIN ;
+        ev.data.ptr = c ;
+        epoll_ctl( epoll_fd, EPOLL_CTL_ADD, fd, &ev );
+        clients.push_back( c );
+        client_count = (int)clients.size() ;
+        clientConnected( c );
+    }
+}
+
+void TCPFeedServer::readClient( FeedClient *c ) {
+    uint8_t buf[4096] ;
+    for( ;; ) {
+        ssize_t n = read( c->fd, buf, sizeof(buf));
+        if( n > 0 ) {
+            clientData( c, buf, (size_t)n );
+            if( c->fd < 0 )
+                return ;
+            continue ;
+        }
+        if( (n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) )
+            return ;
+        closeClient( c );
+        return ;
+    }
+}
+
+void TCPFeedServer::broadcast( FeedChunk *chunk ) {
+    for( FeedClient *c : clients ) {
+        if( (c->fd >= 0) && c->ready ) {
+            enqueue( c, chunk );
+        }
+    }
+    releaseChunk( chunk );
+}
+
+void TCPFeedServer::enqueue( FeedClient *c, FeedChunk *chunk ) {
+    if( c->queued + chunk->len > FEED_CLIENT_MAXQUEUE ) {
+        // too slow, drop it rather than buffering without limit
+        dropped_clients++ ;
+        closeClient( c );
+        return ;
+    }
+    bool idle = c->out.empty() ;
+    chunk->refs++ ;
+    c->out.push_back( chunk );
+    c->queued += chunk->len ;
+    // when data is already waiting, EPOLLOUT will send this chunk too
+    if( idle )
+        flushClient( c );
+}
+
+// write as much as the socket takes, returns false if the client was closed
+bool TCPFeedServer::flushClient( FeedClient *c ) {
+    while( !c->out.empty() ) {
+        struct iovec iov[FEED_MAX_IOV] ;
+        int count = 0 ;
+        for( FeedChunk *chunk : c->out ) {
+            if( count == FEED_MAX_IOV )
+                break ;
+            size_t skip = count == 0 ? c->offset : 0 ;
+            iov[count].iov_base = chunk->data + skip ;
+            iov[count].iov_len = chunk->len - skip ;
+            count++ ;
+        }
+        ssize_t n = writev( c->fd, iov, count );
+        if( n < 0 ) {
+            if( (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR) )
+                break ;
+            closeClient( c );
+            return( false );
+        }
+        size_t sent = (size_t)n ;
+        c->queued -= sent ;
+        while( sent > 0 ) {
+            FeedChunk *chunk = c->out.front() ;
+            size_t left = chunk->len - c->offset ;
+            if( sent < left ) {
+                c->offset += sent ;
+                break ;
+            }
+            sent -= left ;
+            c->offset = 0 ;
+            c->out.pop_front();
+            releaseChunk( chunk );
+        }
+    }
+
+    // only wait for EPOLLOUT while something is left to send
+    bool writing = !c->out.empty() ;
+    if( writing != c->writing ) {
+        struct epoll_event ev ;
+        memset( &ev, 0, sizeof(ev));
+        ev.events = writing ? EPOLLIN | EPOLLOUT : EPOLLIN ;
+        ev.data.ptr = c ;
+        epoll_ctl( epoll_fd, EPOLL_CTL_MOD, c->fd, &ev );
+        c->writing = writing ;
+    }
+    return( true );
+}
+
+// server thread : send data to one client only, e.g. a protocol reply
+void TCPFeedServer::sendTo( FeedClient *c, const void *data, size_t len ) {
+    if( c->fd < 0 )
+        return ;
+    FeedChunk *chunk = newChunk( len );
+    memcpy( chunk->data, data, len );
+    chunk->len = len ;
+    enqueue( c, chunk );
+    releaseChunk( chunk );
+}
+
+void TCPFeedServer::closeClient( FeedClient *c ) {
+    if( c->fd < 0 )
+        return ;
+    clientClosed( c );
+    epoll_ctl( epoll_fd, EPOLL_CTL_DEL, c->fd, nullptr );
+    close( c->fd );
+    c->fd = -1 ;
+    for( FeedChunk *chunk : c->out ) {
+        releaseChunk( chunk );
+    }
+    c->out.clear();
+    c->queued = 0 ;
+}
+
+// closed clients are deleted once no epoll event can point to them
+void TCPFeedServer::removeClosed() {
+    size_t j = 0 ;
+    for( size_t i = 0 ; i < clients.size() ; i++ ) {
+        if( clients[i]->fd < 0 ) {
+            delete clients[i] ;
+        } else {
+            clients[j++] = clients[i] ;
+        }
+    }
+    clients.resize( j );
+    client_count = (int)clients.size() ;
+}
+
+void TCPFeedServer::clientConnected( FeedClient *c ) {
+    (void)c ;
+}
+
+void TCPFeedServer::clientData( FeedClient *c, const uint8_t *data, size_t len ) {
+    // output only feed, whatever the client sends is ignored
+    (void)c ;
+    (void)data ;
+    (void)len ;
+}
+
+void TCPFeedServer::clientClosed( FeedClient *c ) {
+    (void)c ;
+}
@@ -0,0 +1,113 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef FEEDSERVER_H
+#define FEEDSERVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include "spscqueue.h"
+
+#define FEED_CHUNK_SIZE (16*1024)           /* bytes gathered before a chunk is handed over */
+#define FEED_MAX_CHUNKS 256                 /* chunks waiting for the server thread */
+#define FEED_CLIENT_MAXQUEUE (512*1024)     /* bytes queued for a client before it is dropped */
+#define FEED_MAX_CLIENTS 64
+
+/* Chunk of output shared by all the clients, freed by the last one */
+typedef struct {
+    int refs ;
+    size_t len ;
+    uint8_t *data ;
+} FeedChunk ;
+
+typedef struct {
+    int fd ;
+    bool ready ;                    /* receives the broadcast output */
+    std::deque<FeedChunk *> out ;
+    size_t offset ;                 /* bytes of out.front() already sent */
+    size_t queued ;
+    bool writing ;                  /* waiting for EPOLLOUT */
+    void *ctx ;                     /* protocol state, see the subclasses */
+} FeedClient ;
+
+/* TCPFeedServer : streams the same output to any number of TCP clients.
+ *
+ * The producer (decode_thread) appends bytes with write() and calls publish()
+ * once per block. The bytes go to the server thread through a lock-free
+ * queue and an eventfd, so the producer never blocks on the network : if
+ * the server thread falls behind, chunks are dropped.
+ *
+ * The server thread runs a non-blocking epoll loop. Each client has its own
+ * queue of shared chunks ; a client with more than FEED_CLIENT_MAXQUEUE
+ * bytes pending is disconnected instead of stalling the others.
+ *
+ * Subclasses override the client* hooks, called from the server thread, to
+ * talk a protocol with their clients. They must call stop() in their own
+ * destructor so the hooks are not called on a half destroyed object.
+ */
+class TCPFeedServer
+{
+public:
+    TCPFeedServer( int max_clients = FEED_MAX_CLIENTS );
+    virtual ~TCPFeedServer();
+
+    bool start( int port );
+    void stop();
+    bool isRunning();
+
+    // producer side, one thread
+    void write( const void *data, size_t len );
+    void publish();
+
+    int clientCount();
+    uint64_t droppedClients();
+    uint64_t droppedChunks();
+
+protected:
+    // server thread side
+    virtual void clientConnected( FeedClient *c );
+    virtual void clientData( FeedClient *c, const uint8_t *data, size_t len );
+    virtual void clientClosed( FeedClient *c );
+    void sendTo( FeedClient *c, const void *data, size_t len );
+    void closeClient( FeedClient *c );
+
+private:
+    std::atomic<bool> running ;
+    std::thread *server ;
+    int listen_fd ;
+    int epoll_fd ;
+    int event_fd ;
+    int max_clients ;
+
+    FeedChunk *pending ;
+    SPSCQueue<FeedChunk *> *chunks ;
+
+    std::vector<FeedClient *> clients ;
+    std::atomic<int> client_count ;
+    std::atomic<uint64_t> dropped_clients ;
+    std::atomic<uint64_t> dropped_chunks ;
+
+    static void serverThread( TCPFeedServer *s );
+    void run();
+    void acceptClients();
+    void readClient( FeedClient *c );
+    void broadcast( FeedChunk *chunk );
+    void enqueue( FeedClient *c, FeedChunk *chunk );
+    bool flushClient( FeedClient *c );
+    void removeClosed();
+    void releaseChunk( FeedChunk *chunk );
+    FeedChunk *newChunk( size_t size );
+};
+
+#endif // FEEDSERVER_H
@@ -0,0 +1,36 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <string.h>
+#include "framededup.h"
+
+FrameDedup::FrameDedup() {
+    memset( slots, 0, sizeof(slots));
+}
+
+bool FrameDedup::isDuplicate( const ADSBRawMSG *msg, uint64_t now ) {
+    // FNV-1a over the message bytes, the length is part of the hash
+    int bytes = (msg->len - 1) / 8 ;
+    uint64_t hash = 0xcbf29ce484222325ULL ^ (uint64_t)bytes ;
+    for( int i = 0 ; i < bytes ; i++ ) {
+        hash ^= msg->msg[i] ;
+        hash *= 0x100000001b3ULL ;
+    }
+    if( hash == 0 )
+        hash = 1 ;      // 0 marks an empty slot
+    DedupSlot *slot = &slots[(hash ^ (hash >> 32)) & (DEDUP_SLOTS - 1)] ;
+    if( (slot->hash == hash) && (now - slot->time < DEDUP_WINDOW)
+            && (slot->receiver != msg->receiver) )
+        return( true );
+    slot->hash = hash ;
+    slot->time = now ;
+    slot->receiver = msg->receiver ;
+    return( false );
+}
@@ -0,0 +1,47 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef FRAMEDEDUP_H
+#define FRAMEDEDUP_H
+
+#include <stdint.h>
+#include "adsbframer.h"
+
+#define DEDUP_WINDOW 100        /* ms a frame is remembered */
+#define DEDUP_SLOTS 4096        /* power of 2 */
+
+/* FrameDedup : drops the frames already heard by another receiver.
+ *
+ * Several dongles at one site hear the same transmissions, the copies only
+ * differ by their timestamps and signal levels. A frame whose bits another
+ * receiver gave less than DEDUP_WINDOW ms ago is a duplicate, the repeats
+ * heard by one receiver are all kept. The frames are remembered by
+ * hash in a direct mapped table : a collision only forgets the older frame,
+ * which is then passed twice, so no frame is ever lost.
+ */
+class FrameDedup
+{
+public:
+    FrameDedup();
+
+    // true when another receiver gave the same bits in the last DEDUP_WINDOW ms
+    bool isDuplicate( const ADSBRawMSG *msg, uint64_t now );
+
+private:
+    typedef struct {
+        uint64_t hash ;
+        uint64_t time ;     /* ms */
+        int receiver ;
+    } DedupSlot ;
+
+    DedupSlot slots[DEDUP_SLOTS] ;
+};
+
+#endif // FRAMEDEDUP_H
@@ -0,0 +1,119 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "framerepair.h"
+
+#define REPAIR_QUEUED 0
+#define REPAIR_FIXED 1
+#define REPAIR_FAILED 2
+
+#define REPAIR_BITS 112                 /* only long frames are repaired */
+
+FrameRepairPool::FrameRepairPool( int threads, RepairFunction repair, RepairCounters *counters ) {
+    this->repair = repair ;
+    this->counters = counters ;
+    head = 0 ;
+    tail = 0 ;
+    exiting = false ;
+    for( int i = 0 ; i < REPAIR_MAX_BACKLOG ; i++ ) {
+        slots[i].state = REPAIR_FAILED ;
+    }
+    for( int i = 0 ; i < threads ; i++ ) {
+        workers.push_back( std::thread( workerThread, this ));
+    }
+}
+
+FrameRepairPool::~FrameRepairPool() {
+    {
+        std::lock_guard<std::mutex> l( lock );
+        exiting = true ;
+    }
+    cond.notify_all();
+    for( std::thread& t : workers ) {
+        t.join();
+    }
+}
+
+// false when the backlog is full, the frame is then dropped
+bool FrameRepairPool::submit( const ADSBRawMSG *msg ) {
+    if( head - tail >= REPAIR_MAX_BACKLOG ) {
+        counters->shed++ ;
+        return( false );
+    }
+    RepairSlot *slot = &slots[head % REPAIR_MAX_BACKLOG] ;
+    slot->timestamp = msg->timestamp ;
+    slot->signal = msg->signal ;
+    slot->receiver = msg->receiver ;
+    slot->rssi = msg->rssi ;
+    memcpy( slot->msg, msg->msg, REPAIR_FRAME_BYTES );
+    memcpy( slot->confidence, msg->confidence, sizeof(slot->confidence) );
+    slot->state.store( REPAIR_QUEUED, std::memory_order_relaxed );
+    head++ ;
+    {
+        std::lock_guard<std::mutex> l( lock );
+        jobs.push_back( slot );
+    }
+    cond.notify_one();
+    return( true );
+}
+
+// next repaired frame, in submission order, nullptr if none is ready.
+// The caller frees it like a frame from the framer
+ADSBRawMSG *FrameRepairPool::pop() {
+    while( tail < head ) {
+        RepairSlot *slot = &slots[tail % REPAIR_MAX_BACKLOG] ;
+        int state = slot->state.load( std::memory_order_acquire );
+        if( state == REPAIR_QUEUED )
+            return( nullptr );
+        tail++ ;
+        if( state == REPAIR_FAILED )
+            continue ;
+        ADSBRawMSG *msg = (ADSBRawMSG *)malloc( sizeof(ADSBRawMSG));
+        msg->msg = (unsigned char *)malloc( REPAIR_BITS + 2 );
+        memset( msg->msg, 0, REPAIR_BITS + 2 );
+        memcpy( msg->msg, slot->msg, REPAIR_FRAME_BYTES );
+        msg->len = REPAIR_BITS + 1 ;
+        msg->timestamp = slot->timestamp ;
+        msg->signal = slot->signal ;
+        msg->receiver = slot->receiver ;
+        msg->rssi = slot->rssi ;
+        memcpy( msg->confidence, slot->confidence, sizeof(msg->confidence) );
+        return( msg );
+    }
+    return( nullptr );
+}
+
+void FrameRepairPool::workerThread( FrameRepairPool *pool ) {
+    pool->run();
+}
+
+void FrameRepairPool::run() {
+    for( ;; ) {
+        RepairSlot *slot ;
+        {
+            std::unique_lock<std::mutex> l( lock );
+            cond.wait( l, [this]() { return exiting || !jobs.empty(); } );
+            if( exiting )
+                return ;
+            slot = jobs.front() ;
+            jobs.pop_front();
+        }
+        // the slot is not touched by the decoder thread until released
+        if( repair( slot->msg, REPAIR_BITS, slot->confidence ) != -1 ) {
+            counters->repaired++ ;
+            slot->state.store( REPAIR_FIXED, std::memory_order_release );
+        } else {
+            counters->failed++ ;
+            slot->state.store( REPAIR_FAILED, std::memory_order_release );
+        }
+    }
+}
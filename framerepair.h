@@ -0,0 +1,84 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef FRAMEREPAIR_H
+#define FRAMEREPAIR_H
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "adsbframer.h"
+
+#define REPAIR_MAX_BACKLOG 256          /* frames submitted and not released yet */
+#define REPAIR_MAX_THREADS 8
+#define REPAIR_FRAME_BYTES 14
+
+typedef int (*RepairFunction)( unsigned char *msg, int bits, const uint8_t *confidence );
+
+/* totals of a pool, owned by its user so they outlive the pool */
+typedef struct {
+    std::atomic<uint64_t> repaired ;
+    std::atomic<uint64_t> failed ;
+    std::atomic<uint64_t> shed ;
+} RepairCounters ;
+
+/* FrameRepairPool : runs the slow error correction of long frames on worker
+ * threads, so the decoder thread never waits for it.
+ *
+ * The decoder thread submits the frames failing the fast checks and later
+ * takes back the repaired ones with pop(), in the order they were
+ * submitted, which is timestamp order. A frame still being repaired holds
+ * back the ones after it. When REPAIR_MAX_BACKLOG frames are pending, new
+ * ones are shed and counted rather than queued, in the counters given
+ * to the constructor.
+ */
+class FrameRepairPool
+{
+public:
+    FrameRepairPool( int threads, RepairFunction repair, RepairCounters *counters );
+    ~FrameRepairPool();
+
+    // decoder thread side
+    bool submit( const ADSBRawMSG *msg );
+    ADSBRawMSG *pop();
+
+private:
+    typedef struct {
+        std::atomic<int> state ;
+        uint64_t timestamp ;
+        uint8_t signal ;
+        uint8_t receiver ;
+        float rssi ;
+        unsigned char msg[REPAIR_FRAME_BYTES] ;
+        uint8_t confidence[long_frame] ;
+    } RepairSlot ;
+
+    RepairFunction repair ;
+    RepairSlot slots[REPAIR_MAX_BACKLOG] ;
+    uint64_t head ;                 /* next frame submitted */
+    uint64_t tail ;                 /* next frame released */
+
+    std::vector<std::thread> workers ;
+    std::mutex lock ;
+    std::condition_variable cond ;
+    std::deque<RepairSlot *> jobs ;
+    bool exiting ;
+
+    RepairCounters *counters ;
+
+    static void workerThread( FrameRepairPool *pool );
+    void run();
+};
+
+#endif // FRAMEREPAIR_H
@@ -0,0 +1,126 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gaincontrol.h"
+
+GainController::GainController( rtlsdr_dev_t *device, int sample_rate, bool crc_known ) {
+    this->device = device ;
+    this->crc_known = crc_known ;
+    interval_samples = (uint64_t)sample_rate * AGC_INTERVAL / 1000 ;
+    mode = GAIN_TUNER ;
+    index = 0 ;
+    direction = 1 ;
+    hold = 0 ;
+    settling = true ;
+    last_score = 0 ;
+    memset( &last, 0, sizeof(last));
+    last_valid = 0 ;
+}
+
+bool GainController::start( int mode, int gain ) {
+    this->mode = mode ;
+    if( mode == GAIN_TUNER ) {
+        return( rtlsdr_set_tuner_gain_mode( device, 0 ) == 0 );
+    }
+    int count = rtlsdr_get_tuner_gains( device, nullptr );
+    if( count <= 0 ) {
+        fprintf( stderr, "No tuner gains, using the tuner AGC\n");
+        fflush(stderr);
+        this->mode = GAIN_TUNER ;
+        return( rtlsdr_set_tuner_gain_mode( device, 0 ) == 0 );
+    }
+    gains.resize( count );
+    rtlsdr_get_tuner_gains( device, gains.data() );
+    if( rtlsdr_set_tuner_gain_mode( device, 1 ) != 0 )
+        return( false );
+    return( setIndex( nearestGain( mode == GAIN_AGC ? AGC_START_GAIN : gain )));
+}
+
+int GainController::gain() {
+    if( mode == GAIN_TUNER )
+        return( AUTO_GAIN );
+    return( gains[index] );
+}
+
+void GainController::update( const FramerStats *stats, uint64_t valid_frames ) {
+    if( mode != GAIN_AGC )
+        return ;
+    if( stats->samples - last.samples < interval_samples )
+        return ;
+    if( settling ) {
+        // measures start now
+        settling = false ;
+        last = *stats ;
+        last_valid = valid_frames ;
+        return ;
+    }
+    double samples = (double)(stats->samples - last.samples) ;
+    double saturation = (stats->saturated - last.saturated) / samples ;
+    double noise = (stats->noise_sum - last.noise_sum) / samples ;
+    uint64_t preambles = stats->preambles - last.preambles ;
+    uint64_t frames = stats->frames - last.frames ;
+    uint64_t valid = valid_frames - last_valid ;
+    double score = (double)(crc_known ? valid : frames) ;
+    last = *stats ;
+    last_valid = valid_frames ;
+
+    bool too_high = (saturation > AGC_MAX_SATURATION) || (noise > AGC_MAX_NOISE) ;
+    if( crc_known && (preambles >= AGC_MIN_PREAMBLES) && (valid < preambles * AGC_MIN_CRC) )
+        too_high = true ;
+    if( too_high ) {
+        direction = -1 ;
+        hold = AGC_HOLD ;
+        setIndex( index - 1 );
+        last_score = 0 ;
+        return ;
+    }
+    if( hold > 0 ) {
+        hold-- ;
+        last_score = score ;
+        return ;
+    }
+    if( score < last_score * (1 - AGC_TOLERANCE) ) {
+        // the last step made it worse
+        direction = -direction ;
+        hold = AGC_HOLD ;
+    } else if( (score <= last_score * (1 + AGC_TOLERANCE)) && (direction < 0) ) {
+        // no better : the higher gain keeps the weak aircraft
+        direction = 1 ;
+        hold = AGC_HOLD ;
+    }
+    last_score = score ;
+    if( !setIndex( index + direction )) {
+        // at the end of the range, probe the other way next time
+        direction = -direction ;
+        hold = AGC_HOLD ;
+    }
+}
+
+int GainController::nearestGain( int gain ) {
+    int best = 0 ;
+    for( int i = 1 ; i < (int)gains.size() ; i++ ) {
+        if( abs( gains[i] - gain ) < abs( gains[best] - gain ))
+            best = i ;
+    }
+    return( best );
+}
+
+bool GainController::setIndex( int i ) {
+    if( (i < 0) || (i >= (int)gains.size()) )
+        return( false );
+    if( rtlsdr_set_tuner_gain( device, gains[i] ) != 0 )
+        return( false );
+    index = i ;
+    settling = true ;
+    return( true );
+}
@@ -0,0 +1,78 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef GAINCONTROL_H
+#define GAINCONTROL_H
+
+#include <stdint.h>
+#include <vector>
+#include "librtlsdr/rtl-sdr.h"
+#include "adsbframer.h"
+
+#define GAIN_AGC 0          /* closed loop, see GainController */
+#define GAIN_TUNER 1        /* the tuner's own AGC */
+#define GAIN_FIXED 2
+
+#define AGC_INTERVAL 1000               /* ms of samples between two decisions */
+#define AGC_HOLD 10                     /* intervals without probing after a step back */
+#define AGC_START_GAIN 300              /* tenth of dB */
+#define AGC_MAX_SATURATION 0.0002       /* ratio of clipped samples */
+#define AGC_MAX_NOISE (MAX_MAGNITUDE / 100)     /* noise floor, -20 dBFS */
+#define AGC_MIN_CRC 0.05                /* ratio of the preambles giving a valid frame */
+#define AGC_MIN_PREAMBLES 100           /* per interval, for the CRC ratio to mean something */
+#define AGC_TOLERANCE 0.1               /* traffic changes, not a better gain */
+
+/* GainController : sets the tuner gain of one device from what the framer
+ * and the decoder see, so each site finds its best gain by itself.
+ *
+ * Once per AGC_INTERVAL of samples :
+ *  - too many clipped samples (strong aircraft nearby), a noise floor too
+ *    high or preambles that are mostly noise (few of them end in a frame
+ *    passing the CRC) : one gain step down
+ *  - otherwise a hill climb on the frames passing the CRC per interval :
+ *    keep stepping in the same direction while it does not get worse, step
+ *    back when it does and stay there AGC_HOLD intervals before probing
+ *    again. Going down must be better, not only as good, so the gain does
+ *    not drift away from the weak aircraft. The tuner gains are the steps.
+ *
+ * The interval after a change is skipped, the USB buffers still hold
+ * samples taken at the previous gain.
+ */
+class GainController
+{
+public:
+    // crc_known : the decoder runs, the valid frames count is meaningful
+    GainController( rtlsdr_dev_t *device, int sample_rate, bool crc_known );
+
+    bool start( int mode, int gain );
+    // demod thread, after each block
+    void update( const FramerStats *stats, uint64_t valid_frames );
+    // tenth of dB, AUTO_GAIN for the tuner's own AGC
+    int gain();
+
+private:
+    rtlsdr_dev_t *device ;
+    int mode ;
+    bool crc_known ;
+    uint64_t interval_samples ;
+    std::vector<int> gains ;    /* tenth of dB, increasing */
+    int index ;
+    int direction ;
+    int hold ;
+    bool settling ;
+    double last_score ;
+    FramerStats last ;
+    uint64_t last_valid ;
+
+    int nearestGain( int gain );
+    bool setIndex( int i );
+};
+
+#endif // GAINCONTROL_H
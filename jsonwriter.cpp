@@ -0,0 +1,205 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <string.h>
+#include <math.h>
+#include "jsonwriter.h"
+#include "json.hpp"
+
+JSONWriter::JSONWriter( char *buffer, size_t size ) {
+    buf = buffer ;
+    this->size = size ;
+    reset();
+}
+
+void JSONWriter::reset() {
+    pos = 0 ;
+    full = false ;
+    depth = 0 ;
+    first[0] = true ;
+    after_key = false ;
+    if( size > 0 )
+        buf[0] = 0 ;
+}
+
+size_t JSONWriter::length() const {
+    return( pos );
+}
+
+// room left, keeping the terminating zero
+size_t JSONWriter::available() const {
+    return( full ? 0 : size - pos - 1 );
+}
+
+bool JSONWriter::overflow() const {
+    return( full );
+}
+
+// always zero terminated as long as size > 0
+const char *JSONWriter::data() const {
+    return( buf );
+}
+
+void JSONWriter::put( char c ) {
+    if( full || (pos + 1 >= size) ) {
+        full = true ;
+        return ;
+    }
+    buf[pos++] = c ;
+    buf[pos] = 0 ;
+}
+
+void JSONWriter::put( const char *s, size_t len ) {
+    if( full || (pos + len >= size) ) {
+        full = true ;
+        return ;
+    }
+    memcpy( buf + pos, s, len );
+    pos += len ;
+    buf[pos] = 0 ;
+}
+
+void JSONWriter::separator() {
+    if( after_key ) {
+        after_key = false ;
+        return ;
+    }
+    if( !first[depth] )
+        put(',');
+    first[depth] = false ;
+}
+
+void JSONWriter::beginObject() {
+    separator();
+    put('{');
+    if( depth < JSON_MAX_DEPTH-1 )
+        depth++ ;
+    first[depth] = true ;
+}
+
+void JSONWriter::endObject() {
+    if( depth > 0 )
+        depth-- ;
+    put('}');
+}
+
+void JSONWriter::beginArray() {
+    separator();
+    put('[');
+    if( depth < JSON_MAX_DEPTH-1 )
+        depth++ ;
+    first[depth] = true ;
+}
+
+void JSONWriter::endArray() {
+    if( depth > 0 )
+        depth-- ;
+    put(']');
+}
+
+void JSONWriter::key( const char *name ) {
+    separator();
+    string( name );
+    put(':');
+    after_key = true ;
+}
+
+void JSONWriter::value( uint64_t x ) {
+    char tmp[24] ;
+    int n = sizeof(tmp) ;
+    separator();
+    do {
+        tmp[--n] = '0' + (x % 10) ;
+        x /= 10 ;
+    } while( x != 0 );
+    put( tmp + n, sizeof(tmp) - n );
+}
+
+void JSONWriter::value( int64_t x ) {
+    if( x >= 0 ) {
+        value( (uint64_t)x );
+        return ;
+    }
+    char tmp[24] ;
+    int n = sizeof(tmp) ;
+    uint64_t u = 0 - (uint64_t)x ;
+    separator();
+    do {
+        tmp[--n] = '0' + (u % 10) ;
+        u /= 10 ;
+    } while( u != 0 );
+    tmp[--n] = '-' ;
+    put( tmp + n, sizeof(tmp) - n );
+}
+
+// same Grisu2 based shortest round-trip formatting as nlohmann::json
+void JSONWriter::value( double x ) {
+    if( !std::isfinite(x) ) {
+        null();
+        return ;
+    }
+    char tmp[64] ;
+    separator();
+    char *end = ::nlohmann::detail::to_chars( tmp, tmp + sizeof(tmp), x );
+    put( tmp, end - tmp );
+}
+
+void JSONWriter::value( bool x ) {
+    separator();
+    if( x )
+        put( "true", 4 );
+    else
+        put( "false", 5 );
+}
+
+void JSONWriter::null() {
+    separator();
+    put( "null", 4 );
+}
+
+void JSONWriter::value( const char *s ) {
+    separator();
+    string( s );
+}
+
+void JSONWriter::string( const char *s ) {
+    static const char hex[] = "0123456789abcdef" ;
+    put('"');
+    for( ;; ) {
+        // copy the run of characters that need no escaping at once
+        const char *run = s ;
+        while( ((unsigned char)*s >= 0x20) && (*s != '"') && (*s != '\\') )
+            s++ ;
+        if( s > run )
+            put( run, s - run );
+        if( *s == 0 )
+            break ;
+        unsigned char c = (unsigned char)*s++ ;
+        switch( c ) {
+        case '"':  put( "\\\"", 2 ); break ;
+        case '\\': put( "\\\\", 2 ); break ;
+        case '\b': put( "\\b", 2 ); break ;
+        case '\f': put( "\\f", 2 ); break ;
+        case '\n': put( "\\n", 2 ); break ;
+        case '\r': put( "\\r", 2 ); break ;
+        case '\t': put( "\\t", 2 ); break ;
+        default: {
+            char u[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+            put( u, 6 );
+        }
+        }
+    }
+    put('"');
+}
+
+void JSONWriter::raw( const char *s, size_t len ) {
+    separator();
+    put( s, len );
+}
@@ -0,0 +1,70 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define JSON_MAX_DEPTH 8
+
+/* JSONWriter : streams JSON text into a caller supplied buffer, without
+ * any allocation. Numbers are formatted exactly like nlohmann::json dump()
+ * so the output can replace it byte for byte, keys are written in the
+ * order they are given (nlohmann sorts them, callers do the same).
+ *
+ * When the buffer is too small the writer stops and overflow() is true.
+ */
+class JSONWriter
+{
+public:
+    JSONWriter( char *buffer, size_t size );
+
+    void reset();
+    size_t length() const ;
+    size_t available() const ;
+    bool overflow() const ;
+    const char *data() const ;
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    void key( const char *name );
+
+    void value( int64_t x );
+    void value( uint64_t x );
+    void value( int x ) { value( (int64_t)x ); }
+    void value( uint32_t x ) { value( (uint64_t)x ); }
+    void value( double x );
+    void value( bool x );
+    void value( const char *s );
+    void null();
+
+    // raw text, used to splice an already formatted value
+    void raw( const char *s, size_t len );
+
+private:
+    char *buf ;
+    size_t size ;
+    size_t pos ;
+    bool full ;
+    int depth ;
+    bool first[JSON_MAX_DEPTH] ;
+    bool after_key ;
+
+    void separator();
+    void string( const char *s );
+    void put( char c );
+    void put( const char *s, size_t len );
+};
+
+#endif // JSONWRITER_H
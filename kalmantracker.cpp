@@ -0,0 +1,174 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <math.h>
+#include "kalmantracker.h"
+
+#define EARTH_RADIUS 6371e3
+#define DEG2RAD (M_PI/180.0)
+
+static const float accel_noise[KALMAN_LANES] = {
+    KALMAN_ACCEL_NOISE*KALMAN_ACCEL_NOISE,
+    KALMAN_ACCEL_NOISE*KALMAN_ACCEL_NOISE,
+    KALMAN_CLIMB_NOISE*KALMAN_CLIMB_NOISE,
+    0
+};
+
+void kalmanInit( KalmanTrack *t ) {
+    for( int k = 0 ; k < KALMAN_LANES ; k++ ) {
+        t->pos[k] = 0 ;
+        t->vel[k] = 0 ;
+        t->p00[k] = 1e8f ;
+        t->p01[k] = 0 ;
+        t->p11[k] = 1e4f ;
+    }
+    t->ref_lat = t->ref_lon = 0 ;
+    t->time = 0 ;
+    t->position_valid = false ;
+    t->altitude_valid = false ;
+}
+
+/* Time update of all the axes up to 'now' :
+ *   x = F.x            with F = [1 dt; 0 1]
+ *   P = F.P.F' + Q     with Q the white acceleration noise model */
+static void kalmanStep( KalmanTrack *t, uint64_t now ) {
+    if( t->time == 0 || now <= t->time ) {
+        if( t->time == 0 ) t->time = now ;
+        return ;
+    }
+    const float dt = (now - t->time) / 1000.0f ;
+    const float dt2 = dt*dt ;
+    const float q0 = dt2*dt/3.0f ;
+    const float q1 = dt2/2.0f ;
+    for( int k = 0 ; k < KALMAN_LANES ; k++ ) {
+        t->pos[k] += t->vel[k] * dt ;
+        t->p00[k] += dt*(2*t->p01[k] + dt*t->p11[k]) + q0*accel_noise[k] ;
+        t->p01[k] += dt*t->p11[k] + q1*accel_noise[k] ;
+        t->p11[k] += dt*accel_noise[k] ;
+    }
+    t->time = now ;
+}
+
+/* Measurement update. 'h' selects the observed state (0 position,
+ * 1 velocity) and 'mask' the observed axes, a null mask leaves the
+ * corresponding lane untouched. */
+static void kalmanMeasure( KalmanTrack *t, int h, const float *z, const float *r, const float *mask ) {
+    for( int k = 0 ; k < KALMAN_LANES ; k++ ) {
+        const float hp0 = h ? t->p01[k] : t->p00[k] ;
+        const float hp1 = h ? t->p11[k] : t->p01[k] ;
+        const float s = (h ? hp1 : hp0) + r[k] ;
+        const float k0 = mask[k] * hp0 / s ;
+        const float k1 = mask[k] * hp1 / s ;
+        const float y = z[k] - (h ? t->vel[k] : t->pos[k]) ;
+        t->pos[k] += k0 * y ;
+        t->vel[k] += k1 * y ;
+        t->p00[k] -= k0 * hp0 ;
+        t->p01[k] -= k0 * hp1 ;
+        t->p11[k] -= k1 * hp1 ;
+    }
+}
+
+/* Longitude difference in [-180, 180), across the antimeridian too */
+static double lonDelta( double lon, double ref ) {
+    double d = fmod( lon - ref + 180.0, 360.0 );
+    if( d < 0 ) d += 360.0 ;
+    return( d - 180.0 );
+}
+
+/* Moves the origin of the local plane to the current position. This is a
+ * translation, velocities and covariances are kept as they are. */
+static void kalmanReanchor( KalmanTrack *t ) {
+    const double east = t->pos[KALMAN_AXIS_EAST] ;
+    const double north = t->pos[KALMAN_AXIS_NORTH] ;
+    if( fabs( east ) < KALMAN_REANCHOR && fabs( north ) < KALMAN_REANCHOR )
+        return ;
+    const double lon = t->ref_lon + east / (EARTH_RADIUS * cos(t->ref_lat * DEG2RAD)) / DEG2RAD ;
+    t->ref_lat += north / EARTH_RADIUS / DEG2RAD ;
+    t->ref_lon = lonDelta( lon, 0 );
+    t->pos[KALMAN_AXIS_EAST] = 0 ;
+    t->pos[KALMAN_AXIS_NORTH] = 0 ;
+}
+
+void kalmanUpdatePosition( KalmanTrack *t, double lat, double lon, uint64_t now ) {
+    kalmanStep( t, now );
+    if( !t->position_valid ) {
+        // first fix becomes the origin of the local plane, velocity is kept
+        t->ref_lat = lat ;
+        t->ref_lon = lon ;
+        for( int k = KALMAN_AXIS_EAST ; k <= KALMAN_AXIS_NORTH ; k++ ) {
+            t->pos[k] = 0 ;
+            t->p00[k] = KALMAN_POSITION_SD*KALMAN_POSITION_SD ;
+            t->p01[k] = 0 ;
+        }
+        t->position_valid = true ;
+        return ;
+    }
+    const float z[KALMAN_LANES] = {
+        (float)(lonDelta( lon, t->ref_lon ) * DEG2RAD * EARTH_RADIUS * cos(t->ref_lat * DEG2RAD)),
+        (float)((lat - t->ref_lat) * DEG2RAD * EARTH_RADIUS),
+        0, 0
+    };
+    const float r[KALMAN_LANES] = {
+        KALMAN_POSITION_SD*KALMAN_POSITION_SD, KALMAN_POSITION_SD*KALMAN_POSITION_SD, 1, 1
+    };
+    const float mask[KALMAN_LANES] = { 1, 1, 0, 0 };
+    kalmanMeasure( t, 0, z, r, mask );
+    kalmanReanchor( t );
+}
+
+void kalmanUpdateVelocity( KalmanTrack *t, float east, float north, uint64_t now ) {
+    kalmanStep( t, now );
+    const float z[KALMAN_LANES] = { east, north, 0, 0 };
+    const float r[KALMAN_LANES] = {
+        KALMAN_VELOCITY_SD*KALMAN_VELOCITY_SD, KALMAN_VELOCITY_SD*KALMAN_VELOCITY_SD, 1, 1
+    };
+    const float mask[KALMAN_LANES] = { 1, 1, 0, 0 };
+    kalmanMeasure( t, 1, z, r, mask );
+}
+
+void kalmanUpdateAltitude( KalmanTrack *t, float altitude, uint64_t now ) {
+    kalmanStep( t, now );
+    if( !t->altitude_valid ) {
+        t->pos[KALMAN_AXIS_UP] = altitude ;
+        t->p00[KALMAN_AXIS_UP] = KALMAN_ALTITUDE_SD*KALMAN_ALTITUDE_SD ;
+        t->p01[KALMAN_AXIS_UP] = 0 ;
+        t->altitude_valid = true ;
+        return ;
+    }
+    const float z[KALMAN_LANES] = { 0, 0, altitude, 0 };
+    const float r[KALMAN_LANES] = { 1, 1, KALMAN_ALTITUDE_SD*KALMAN_ALTITUDE_SD, 1 };
+    const float mask[KALMAN_LANES] = { 0, 0, 1, 0 };
+    kalmanMeasure( t, 0, z, r, mask );
+}
+
+void kalmanUpdateClimbRate( KalmanTrack *t, float rate, uint64_t now ) {
+    kalmanStep( t, now );
+    const float z[KALMAN_LANES] = { 0, 0, rate, 0 };
+    const float r[KALMAN_LANES] = { 1, 1, KALMAN_CLIMB_SD*KALMAN_CLIMB_SD, 1 };
+    const float mask[KALMAN_LANES] = { 0, 0, 1, 0 };
+    kalmanMeasure( t, 1, z, r, mask );
+}
+
+/* Extrapolate the state at time 'at' (ms elapsed since epoch) without
+ * changing it. Returns false until a first position was received. */
+bool kalmanPredict( const KalmanTrack *t, uint64_t at, double *lat, double *lon, float *altitude ) {
+    if( !t->position_valid )
+        return( false );
+
+    const float dt = ((int64_t)at - (int64_t)t->time) / 1000.0f ;
+    const double east  = t->pos[KALMAN_AXIS_EAST]  + t->vel[KALMAN_AXIS_EAST] * dt ;
+    const double north = t->pos[KALMAN_AXIS_NORTH] + t->vel[KALMAN_AXIS_NORTH] * dt ;
+
+    *lat = t->ref_lat + north / EARTH_RADIUS / DEG2RAD ;
+    *lon = t->ref_lon + east / (EARTH_RADIUS * cos(t->ref_lat * DEG2RAD)) / DEG2RAD ;
+    *lon = lonDelta( *lon, 0 );
+    *altitude = t->altitude_valid ? t->pos[KALMAN_AXIS_UP] + t->vel[KALMAN_AXIS_UP] * dt : 0 ;
+    return( true );
+}
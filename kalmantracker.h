@@ -0,0 +1,60 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef KALMANTRACKER_H
+#define KALMANTRACKER_H
+
+#include <stdint.h>
+
+/* Constant velocity Kalman filter used to predict aircraft positions
+ * between two squitters.
+ *
+ * The state is kept in a local tangent plane centered on the first fix
+ * (east, north, up in meters), moved to the track once it is
+ * KALMAN_REANCHOR away so the plane stays a good approximation. The three axes are filtered independently
+ * with a [position, velocity] state each, so every step is the same 2x2
+ * update run over the axes. Values are stored per lane (the 4th lane is
+ * padding) so these loops vectorize, and the whole filter is a fixed size
+ * structure living inside struct aircraft : no allocation at all.
+ */
+
+#define KALMAN_LANES 4
+#define KALMAN_AXIS_EAST 0
+#define KALMAN_AXIS_NORTH 1
+#define KALMAN_AXIS_UP 2
+
+#define KALMAN_ACCEL_NOISE 3.0f     /* Horizontal acceleration, m/s^2 */
+#define KALMAN_CLIMB_NOISE 1.0f     /* Vertical acceleration, m/s^2 */
+#define KALMAN_POSITION_SD 50.0f    /* CPR position, m */
+#define KALMAN_VELOCITY_SD 2.0f     /* TC19 velocity, m/s */
+#define KALMAN_ALTITUDE_SD 8.0f     /* 25 ft altitude steps, m */
+#define KALMAN_CLIMB_SD 0.5f        /* 64 fpm vertical rate steps, m/s */
+#define KALMAN_REANCHOR 50e3f       /* Distance from the origin moving it to the track, m */
+
+typedef struct {
+    float pos[KALMAN_LANES] ;
+    float vel[KALMAN_LANES] ;
+    float p00[KALMAN_LANES] ;       /* Covariance, symmetric so p10 == p01 */
+    float p01[KALMAN_LANES] ;
+    float p11[KALMAN_LANES] ;
+    double ref_lat, ref_lon ;       /* Origin of the local plane */
+    uint64_t time ;                 /* ms elapsed since epoch of the state */
+    bool position_valid ;
+    bool altitude_valid ;
+} KalmanTrack ;
+
+void kalmanInit( KalmanTrack *t );
+void kalmanUpdatePosition( KalmanTrack *t, double lat, double lon, uint64_t now );
+void kalmanUpdateVelocity( KalmanTrack *t, float east, float north, uint64_t now );
+void kalmanUpdateAltitude( KalmanTrack *t, float altitude, uint64_t now );
+void kalmanUpdateClimbRate( KalmanTrack *t, float rate, uint64_t now );
+bool kalmanPredict( const KalmanTrack *t, uint64_t at, double *lat, double *lon, float *altitude );
+
+#endif // KALMANTRACKER_H
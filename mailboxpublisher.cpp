@@ -0,0 +1,155 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "mailboxpublisher.h"
+
+// Same document as nlohmann::json used to produce, keys in sorted order
+void writeUpdate( JSONWriter& w, ADSBUpdate *msg ) {
+    uint8_t  update_type = msg->update_type ;
+    AircraftState *ac = &msg->state ;
+    bool lost = (update_type == ADSBUPDATE_TYPE_AIRCRAFTLOST) ;
+
+    w.beginObject();
+    if( !lost ) {
+        w.key("altitude");       w.value( ac->altitude );
+        w.key("emergency");      w.value( ac->emergency );
+        w.key("flight");         w.value( ac->flight );
+    }
+    w.key("icao");               w.value( msg->addr );
+    if( !lost ) {
+        w.key("lat");            w.value( ac->lat );
+        w.key("lon");            w.value( ac->lon );
+        w.key("position_valid"); w.value( ac->position_valid );
+        w.key("rssi");           w.value( ac->rssi );
+        w.key("speed");          w.value( ac->speed );
+        w.key("squawk");         w.value( ac->squawk );
+    }
+    w.key("update_type");        w.value( (int)update_type );
+    switch( update_type ) {
+    case ADSBUPDATE_TYPE_AIRCRAFTLOST:
+        w.key("update_type_msg"); w.value( "ADSBUPDATE_TYPE_AIRCRAFTLOST" );
+        break ;
+    case ADSBUPDATE_TYPE_AIRCRAFTMOVE:
+        w.key("update_type_msg"); w.value( "ADSBUPDATE_TYPE_AIRCRAFTMOVE" );
+        break ;
+    case ADSBUPDATE_TYPE_NEWAIRCRAFT:
+        w.key("update_type_msg"); w.value( "ADSBUPDATE_TYPE_NEWAIRCRAFT" );
+        break ;
+    }
+    if( !lost ) {
+        w.key("vert_rate");      w.value( ac->vert_rate );
+        w.key("vert_rate_sign"); w.value( ac->vert_rate_sign );
+    }
+    w.endObject();
+}
+
+MailboxPublisher::MailboxPublisher( TMBox *box ) {
+    this->box = box ;
+    max_updates = 1 ;
+    max_latency = 0 ;
+    batch = nullptr ;
+    writer = nullptr ;
+    count = 0 ;
+    first = 0 ;
+}
+
+MailboxPublisher::~MailboxPublisher() {
+    flush();
+    delete writer ;
+    free( batch );
+}
+
+void MailboxPublisher::setBatching( int max_updates, int max_latency ) {
+    flush();
+    this->max_updates = max_updates ;
+    this->max_latency = max_latency ;
+    if( (max_updates > 1) && (batch == nullptr) ) {
+        batch = (char *)malloc( MAILBOX_BATCH_MAXLEN );
+        writer = new JSONWriter( batch, MAILBOX_BATCH_MAXLEN );
+    }
+}
+
+void MailboxPublisher::post( const char *text, size_t len ) {
+    // the payload is handed over to the VM, it cannot come from a pool
+    TMBoxMessage *boxmessage = (TMBoxMessage *)malloc( sizeof(TMBoxMessage));
+    boxmessage->fromTID = 0 ;
+    boxmessage->memsize = len + 1 ;
+    boxmessage->payload = (char *)malloc( boxmessage->memsize);
+    memcpy( boxmessage->payload, text, len );
+    boxmessage->payload[len] = 0 ;
+    box->postMessage( boxmessage );
+}
+
+void MailboxPublisher::publish( ADSBUpdate *msg, uint64_t now ) {
+    if( max_updates <= 1 ) {
+        char text[JSON_UPDATE_MAXLEN] ;
+        JSONWriter w( text, sizeof(text) );
+        writeUpdate( w, msg );
+        free(msg);
+        // fprintf( stdout, "%s\n", text ); fflush(stdout);
+        post( text, w.length() );
+        return ;
+    }
+
+    append( now );
+    writeUpdate( *writer, msg );
+    free(msg);
+    count++ ;
+    if( count >= max_updates ) {
+        flush();
+    }
+}
+
+// same as publish() for a JSON string, such as an AVR frame
+void MailboxPublisher::publishText( const char *text, uint64_t now ) {
+    if( max_updates <= 1 ) {
+        char json[JSON_UPDATE_MAXLEN] ;
+        JSONWriter w( json, sizeof(json) );
+        w.value( text );
+        post( json, w.length() );
+        return ;
+    }
+    append( now );
+    writer->value( text );
+    count++ ;
+    if( count >= max_updates ) {
+        flush();
+    }
+}
+
+// opens a batch if needed, with room for one more item
+void MailboxPublisher::append( uint64_t now ) {
+    // keep room for this update and the closing bracket
+    if( (count > 0) && (writer->available() < JSON_UPDATE_MAXLEN + 1) ) {
+        flush();
+    }
+    if( count == 0 ) {
+        writer->reset();
+        writer->beginArray();
+        first = now ;
+    }
+}
+
+// called regularly to send a batch that waited long enough
+void MailboxPublisher::poll( uint64_t now ) {
+    if( (count > 0) && (now - first >= (uint64_t)max_latency) ) {
+        flush();
+    }
+}
+
+void MailboxPublisher::flush() {
+    if( count == 0 )
+        return ;
+    writer->endArray();
+    post( writer->data(), writer->length() );
+    count = 0 ;
+}
@@ -0,0 +1,60 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef MAILBOXPUBLISHER_H
+#define MAILBOXPUBLISHER_H
+
+#include <stdint.h>
+#include "vmsystem.h"
+#include "jsonwriter.h"
+#include "modesdecoder.h"
+
+#define JSON_UPDATE_MAXLEN 512          /* Longest JSON text of one update */
+#define MAILBOX_BATCH_MAXLEN (64*1024)  /* Longest batch message */
+#define DEFAULT_BATCH_UPDATES 100
+#define DEFAULT_BATCH_LATENCY 50        /* ms */
+
+void writeUpdate( JSONWriter& w, ADSBUpdate *msg );
+
+/* MailboxPublisher : posts the updates as JSON to the script mailbox.
+ *
+ * By default every update is its own message. In batching mode updates
+ * are collected in a JSON array posted as one message when it holds
+ * 'max_updates' updates or when its first update is 'max_latency' ms old,
+ * so the script wakes up a few tens of times per second whatever the
+ * traffic.
+ */
+class MailboxPublisher
+{
+public:
+    MailboxPublisher( TMBox *box );
+    ~MailboxPublisher();
+
+    void setBatching( int max_updates, int max_latency );
+    void publish( ADSBUpdate *msg, uint64_t now );
+    void publishText( const char *text, uint64_t now );
+    void poll( uint64_t now );
+    void flush();
+
+private:
+    TMBox *box ;
+    int max_updates ;
+    int max_latency ;
+
+    char *batch ;
+    JSONWriter *writer ;
+    int count ;
+    uint64_t first ;
+
+    void post( const char *text, size_t len );
+    void append( uint64_t now );
+};
+
+#endif // MAILBOXPUBLISHER_H
@@ -32,6 +32,8 @@
 // OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "modesdecoder.h"
+#include "aircraftsnapshot.h"
+#include <algorithm>
 #include <semaphore.h>
 #ifdef _WIN32
 #include <windows.h>
@@ -173,6 +175,11 @@ ModeSDecoder::ModeSDecoder()
 {
     aggressive = 1 ;
     fix_errors = 1 ;
+    repair_threads = 1 ;
+    repair_pool = nullptr ;
+    repair_counters.repaired = 0 ;
+    repair_counters.failed = 0 ;
+    repair_counters.shed = 0 ;
     check_crc = 1 ;
     metric = 1 ;
 
@@ -182,31 +189,171 @@ ModeSDecoder::ModeSDecoder()
     memset( icao_cache,0,sizeof(uint32_t)*MODES_ICAO_CACHE_LEN*2);
     aircrafts = NULL;
     queue = new ADSBUpdateQueue(100);
+
+    receiver_valid = false;
+    receiver_lat = receiver_lon = 0;
+    receiver_range = MODES_MAX_RANGE * 1000;
+    valid_messages = 0;
+    accepted_positions = 0;
+    rejected_positions = 0;
+
+    aircraft_snapshot = new AircraftSnapshot();
+    snapshot_time = 0;
+    memset( clock_ticks, 0, sizeof(clock_ticks) );
+    memset( clock_ms, 0, sizeof(clock_ms) );
+}
+
+/* Only once the decoder thread and the readers of the snapshot are gone. */
+ModeSDecoder::~ModeSDecoder()
+{
+    /* joins the repair workers */
+    delete repair_pool ;
+    while (aircrafts) {
+        struct aircraft *a = aircrafts;
+        aircrafts = a->next;
+#ifdef _WIN32
+        CloseHandle( a->mutex );
+#else
+        sem_destroy( &a->mutex );
+#endif
+        history_pool.release( a->history );
+        free(a);
+    }
+    while( hasMSG() )
+        free( popMSG() );
+    delete queue ;
+    free( icao_cache );
+    delete aircraft_snapshot ;
 }
 
-void ModeSDecoder::pushRawMSG( ADSBRawMSG *msg ) {
+/* Decode one frame. Returns true if its CRC is valid, in which case msg
+ * holds the frame with its bit errors fixed. The caller still owns msg. */
+bool ModeSDecoder::pushRawMSG( ADSBRawMSG *msg ) {
     struct modesMessage mm;
 
-    decodeModesMessage( &mm, msg->msg, msg->len );
+    mm.rssi = msg->rssi ;
+    mm.time = frameTime( msg );
+    decodeModesMessage( &mm, msg->msg, msg->len, msg->confidence );
     removeStaleAircrafts();
-    free( msg->msg );
-    free( msg );
+    if( !mm.crcok ) {
+        // comes back through popRepaired() if two bit errors are fixed
+        if( (repair_threads > 0) && fix_errors && aggressive && (mm.msgtype == 17) ) {
+            if( repair_pool == nullptr )
+                repair_pool = new FrameRepairPool( repair_threads, fixTwoBitsErrors, &repair_counters );
+            repair_pool->submit( msg );
+        }
+        return( false );
+    }
+    valid_messages++;
+    memcpy( msg->msg, mm.msg, mm.msgbits / 8 );
+    return( true );
+}
+
+/* Time a frame was received. The newest frame of a receiver is decoded
+ * as it comes, the older ones, given back by the repair pool, are dated
+ * from their timestamp relative to it. */
+uint64_t ModeSDecoder::frameTime( const ADSBRawMSG *msg ) {
+    int rx = msg->receiver < ADSB_MAX_RECEIVERS ? msg->receiver : 0 ;
+    uint64_t now = getTimeStamp();
+    uint64_t age = (clock_ticks[rx] - msg->timestamp) / (TIMESTAMP_CLOCK / 1000) ;
+    // a restarted device counts from 0 again
+    if( (clock_ms[rx] == 0) || (msg->timestamp >= clock_ticks[rx]) ||
+            (age > MODES_INTERACTIVE_TTL*1000) ) {
+        clock_ticks[rx] = msg->timestamp ;
+        clock_ms[rx] = now ;
+        return( now );
+    }
+    return( clock_ms[rx] - age );
 }
 
 bool ModeSDecoder::hasMSG() {
     return( !queue->isEmpty() );
 }
 
+/* Next frame fixed by the repair pool, in the order they failed. It is
+ * given back to pushRawMSG(), which dates it from its timestamp and drops
+ * it if newer frames of the aircraft were applied meanwhile. The caller
+ * then frees it. */
+ADSBRawMSG *ModeSDecoder::popRepaired() {
+    if( repair_pool == nullptr )
+        return( nullptr );
+    return( repair_pool->pop() );
+}
+
+/* 0 repairs the frames inline, in the decoder thread. Only while the
+ * decoder thread is stopped, frames being repaired are dropped. The new
+ * pool starts with the next frame to repair. */
+bool ModeSDecoder::setRepairThreads( int threads ) {
+    if( (threads < 0) || (threads > REPAIR_MAX_THREADS) )
+        return( false );
+    delete repair_pool ;
+    repair_pool = nullptr ;
+    repair_threads = threads ;
+    return( true );
+}
+
 ADSBUpdate *ModeSDecoder::popMSG() {
     ADSBUpdate *msg = nullptr ;
     queue->consume(msg);
     return( msg );
 }
 
+/* Copy the trail of an aircraft, oldest point first. Safe to call from any
+ * thread. Returns the number of points copied, 0 if the aircraft is unknown
+ * or has no position yet. 'base' receives the ms timestamp the point times
+ * are relative to. */
+int ModeSDecoder::getTrail( uint32_t addr, TrackPoint *points, int max_points, uint64_t *base ) {
+    int n = 0 ;
+    std::lock_guard<std::mutex> lock(aircrafts_lock);
+    struct aircraft *a = findAircraft(addr);
+    if( a == NULL )
+        return(0);
+#ifdef _WIN32
+    waitForMutex( a->mutex );
+#else
+    sem_wait(&a->mutex );
+#endif
+    if( a->history != nullptr ) {
+        n = trackHistoryCopy( a->history, points, max_points );
+        *base = a->history->base ;
+    }
+#ifdef _WIN32
+    releaseMutex( a->mutex );
+#else
+    sem_post(&a->mutex);
+#endif
+    return( n );
+}
+
+/* Extrapolate the position of an aircraft at time 'at' (ms elapsed since
+ * epoch) from its tracking filter. Safe to call from any thread. Returns
+ * false if the aircraft is unknown or never reported a position. */
+bool ModeSDecoder::predictPosition( uint32_t addr, uint64_t at, double *lat, double *lon, int *altitude ) {
+    bool ok ;
+    float alt = 0 ;
+    std::lock_guard<std::mutex> lock(aircrafts_lock);
+    struct aircraft *a = findAircraft(addr);
+    if( a == NULL )
+        return(false);
+#ifdef _WIN32
+    waitForMutex( a->mutex );
+#else
+    sem_wait(&a->mutex );
+#endif
+    ok = kalmanPredict( &a->kalman, at, lat, lon, &alt );
+#ifdef _WIN32
+    releaseMutex( a->mutex );
+#else
+    sem_post(&a->mutex);
+#endif
+    *altitude = (int)lround( alt / 0.3048f );
+    return( ok );
+}
+
 /* Decode a raw Mode S message demodulated as a stream of bytes by
  * detectModeS(), and split it into fields populating a modesMessage
  * structure. */
-void ModeSDecoder::decodeModesMessage(struct modesMessage *mm, unsigned char *msg, int len_msg ) {
+void ModeSDecoder::decodeModesMessage(struct modesMessage *mm, unsigned char *msg, int len_msg, const uint8_t *confidence ) {
     (void)len_msg;
     uint32_t crc2;   /* Computed CRC, used to verify the message CRC. */
     char *ais_charset = (char *)"?ABCDEFGHIJKLMNOPQRSTUVWXYZ????? ???????????????0123456789??????";
@@ -233,11 +380,11 @@ void ModeSDecoder::decodeModesMessage(struct modesMessage *mm, unsigned char *ms
     if (!mm->crcok && fix_errors &&
             (mm->msgtype == 11 || mm->msgtype == 17))
     {
-        if ((mm->errorbit = fixSingleBitErrors(msg,mm->msgbits)) != -1) {
+        if ((mm->errorbit = fixSingleBitErrors(msg,mm->msgbits,confidence)) != -1) {
             mm->crc = modesChecksum(msg,mm->msgbits);
             mm->crcok = 1;
-        } else if ( aggressive && mm->msgtype == 17 &&
-                    (mm->errorbit = fixTwoBitsErrors(msg,mm->msgbits)) != -1)
+        } else if ( aggressive && mm->msgtype == 17 && repair_threads == 0 &&
+                    (mm->errorbit = fixTwoBitsErrors(msg,mm->msgbits,confidence)) != -1)
         {
             mm->crc = modesChecksum(msg,mm->msgbits);
             mm->crcok = 1;
@@ -385,6 +532,9 @@ void ModeSDecoder::decodeModesMessage(struct modesMessage *mm, unsigned char *ms
                 mm->heading = (360.0/128) * (((msg[5] & 3) << 5) |
                         (msg[6] >> 3));
             }
+        } else if (mm->metype == 28 && mm->mesub == 1) {
+            /* Extended Squitter Aircraft Status: emergency state */
+            mm->emergency = msg[5] >> 5;
         }
     }
     mm->phase_corrected = 0; /* Set to 1 by the caller if needed. */
@@ -400,7 +550,7 @@ struct aircraft * ModeSDecoder::processReceivedData(struct modesMessage *mm) {
     uint32_t addr;
     struct aircraft *a, *aux;
     bool newplane = false ;
-    bool altitude_or_heading_change = false ;
+    uint16_t changes = 0 ;
 
     if ( check_crc && mm->crcok == 0) return NULL;
     addr = (mm->aa1 << 16) | (mm->aa2 << 8) | mm->aa3;
@@ -409,8 +559,10 @@ struct aircraft * ModeSDecoder::processReceivedData(struct modesMessage *mm) {
     a = findAircraft(addr);
     if (!a) {
         a = createNewAircraft(addr);
+        aircrafts_lock.lock();
         a->next = aircrafts;
         aircrafts = a;
+        aircrafts_lock.unlock();
         newplane = true ;
 
     } else {
@@ -438,39 +590,72 @@ struct aircraft * ModeSDecoder::processReceivedData(struct modesMessage *mm) {
     sem_wait(&a->mutex );
 #endif
 
-    a->seen = getTimeStamp() ;
+    /* A frame older than the last one applied, back from the repair
+     * pool : its data is superseded, the tracker can't go back in time. */
+    if (!newplane && mm->time < a->seen) {
+#ifdef _WIN32
+        releaseMutex( a->mutex );
+#else
+        sem_post(&a->mutex);
+#endif
+        return a;
+    }
+    a->seen = mm->time ;
     a->messages++;
-    a->vert_rate = mm->vert_rate ;
-    a->vert_rate_sign = mm->vert_rate_sign ;
+    /* Averaged as power, over about the last 8 messages. */
+    double power = pow(10, mm->rssi / 10);
+    if (a->messages == 1) a->signal_power = power;
+    else a->signal_power += (power - a->signal_power) / 8;
 
     if (mm->msgtype == 0 || mm->msgtype == 4 || mm->msgtype == 20) {
+        if (a->altitude != mm->altitude) changes |= ADSBUPDATE_CHANGE_ALTITUDE;
         a->altitude = mm->altitude;
-        altitude_or_heading_change = true ;
+        if (a->altitude) kalmanUpdateAltitude(&a->kalman, a->altitude * 0.3048f, a->seen);
+    } else if (mm->msgtype == 5 || mm->msgtype == 21) {
+        if (a->squawk != mm->identity) changes |= ADSBUPDATE_CHANGE_SQUAWK;
+        a->squawk = mm->identity;
     } else if (mm->msgtype == 17) {
         if (mm->metype >= 1 && mm->metype <= 4) {
+            if (memcmp(a->flight, mm->flight, sizeof(a->flight))) changes |= ADSBUPDATE_CHANGE_FLIGHT;
             memcpy(a->flight, mm->flight, sizeof(a->flight));
         } else if (mm->metype >= 9 && mm->metype <= 18) {
+            if (a->altitude != mm->altitude) changes |= ADSBUPDATE_CHANGE_ALTITUDE;
             a->altitude = mm->altitude;
+            if (a->altitude) kalmanUpdateAltitude(&a->kalman, a->altitude * 0.3048f, a->seen);
             if (mm->fflag) {
                 a->odd_cprlat = mm->raw_latitude;
                 a->odd_cprlon = mm->raw_longitude;
-                a->odd_cprtime = mstime();
+                a->odd_cprtime = mm->time;
             } else {
                 a->even_cprlat = mm->raw_latitude;
                 a->even_cprlon = mm->raw_longitude;
-                a->even_cprtime = mstime();
+                a->even_cprtime = mm->time;
             }
             /* If the two data is less than 10 seconds apart, compute
              * the position. */
             if (abs(a->even_cprtime - a->odd_cprtime) <= 10000) {
-                decodeCPR(a);
+                if (decodeCPR(a)) changes |= ADSBUPDATE_CHANGE_POSITION;
             }
         } else if (mm->metype == 19) {
             if (mm->mesub == 1 || mm->mesub == 2) {
                 a->speed = mm->velocity;
                 a->track = mm->heading;
-                altitude_or_heading_change = true ;
+                a->vert_rate = mm->vert_rate;
+                a->vert_rate_sign = mm->vert_rate_sign;
+                /* Velocity components are in knots, 1 = west and 1 = south. */
+                float east = (mm->ew_dir ? -mm->ew_velocity : mm->ew_velocity) * 0.514444f;
+                float north = (mm->ns_dir ? -mm->ns_velocity : mm->ns_velocity) * 0.514444f;
+                kalmanUpdateVelocity(&a->kalman, east, north, a->seen);
+                if (mm->vert_rate) {
+                    /* 64 fpm steps, 1 = no information. */
+                    float climb = (mm->vert_rate - 1) * 64 * 0.3048f / 60;
+                    kalmanUpdateClimbRate(&a->kalman, mm->vert_rate_sign ? -climb : climb, a->seen);
+                }
+                changes |= ADSBUPDATE_CHANGE_VELOCITY ;
             }
+        } else if (mm->metype == 28 && mm->mesub == 1) {
+            if (a->emergency != mm->emergency) changes |= ADSBUPDATE_CHANGE_EMERGENCY;
+            a->emergency = mm->emergency;
         }
     }
 
@@ -481,23 +666,45 @@ struct aircraft * ModeSDecoder::processReceivedData(struct modesMessage *mm) {
 #endif
 
     if( newplane ) {
-        ADSBUpdate* msg = (ADSBUpdate *)malloc( sizeof(ADSBUpdate));
-        msg->ac = a ;
-        msg->addr = a->addr ;
-        msg->update_type = ADSBUPDATE_TYPE_NEWAIRCRAFT ;
-        queue->add( msg );
-
-    } else if( altitude_or_heading_change ) {
-        ADSBUpdate* msg = (ADSBUpdate *)malloc( sizeof(ADSBUpdate));
-        msg->ac = a ;
-        msg->addr = a->addr ;
-        msg->update_type = ADSBUPDATE_TYPE_AIRCRAFTMOVE ;
-        queue->add( msg );
+        queueUpdate( a, ADSBUPDATE_TYPE_NEWAIRCRAFT, ADSBUPDATE_CHANGE_ALL );
+    } else if( changes ) {
+        queueUpdate( a, ADSBUPDATE_TYPE_AIRCRAFTMOVE, changes );
     }
 
     return a;
 }
 
+/* Queue an update carrying a copy of the aircraft state. */
+void ModeSDecoder::queueUpdate(struct aircraft *a, uint8_t update_type, uint16_t changes) {
+    ADSBUpdate* msg = (ADSBUpdate *)malloc( sizeof(ADSBUpdate));
+    AircraftState *st = &msg->state ;
+    msg->addr = a->addr ;
+    msg->update_type = update_type ;
+    msg->changes = changes ;
+    copyState( st, a );
+    queue->add( msg );
+}
+
+/* Copy the part of the aircraft state shown to the outside world. */
+void ModeSDecoder::copyState(AircraftState *st, struct aircraft *a) {
+    st->addr = a->addr ;
+    memcpy( st->flight, a->flight, sizeof(st->flight));
+    st->altitude = a->altitude ;
+    st->speed = a->speed ;
+    st->vert_rate_sign = a->vert_rate_sign ;
+    st->vert_rate = a->vert_rate ;
+    st->track = a->track ;
+    st->squawk = a->squawk ;
+    st->emergency = a->emergency ;
+    st->position_valid = a->position_valid ;
+    st->rssi = a->signal_power > 0 ? round(100 * log10(a->signal_power)) / 10 : 0 ;
+    st->lat = a->lat ;
+    st->lon = a->lon ;
+    st->position_time = a->position_time ;
+    st->seen = a->seen ;
+    st->messages = a->messages ;
+}
+
 /* When in interactive mode If we don't receive new nessages within
  * MODES_INTERACTIVE_TTL seconds we remove the aircraft from the list. */
 void ModeSDecoder::removeStaleAircrafts(void) {
@@ -513,6 +720,12 @@ void ModeSDecoder::removeStaleAircrafts(void) {
             /* Remove the element from the linked list, with care
              * if we are removing the first element. */
             addr = a->addr ;
+            aircrafts_lock.lock();
+            if (!prev)
+                aircrafts = next;
+            else
+                prev->next = next;
+            aircrafts_lock.unlock();
 #ifdef _WIN32
             waitForMutex( a->mutex );
             CloseHandle( a->mutex );
@@ -520,17 +733,15 @@ void ModeSDecoder::removeStaleAircrafts(void) {
             sem_wait(&a->mutex );
             sem_destroy( &a->mutex );
 #endif
+            history_pool.release( a->history );
             free(a);
-            if (!prev)
-                aircrafts = next;
-            else
-                prev->next = next;
             a = next;
 
             /* send message the plane has been deleted */
             ADSBUpdate* msg = (ADSBUpdate *)malloc( sizeof(ADSBUpdate));
-            msg->ac = nullptr ;
+            memset( msg, 0, sizeof(ADSBUpdate));
             msg->addr = addr ;
+            msg->state.addr = addr ;
             msg->update_type = ADSBUPDATE_TYPE_AIRCRAFTLOST ;
             queue->add( msg );
         } else {
@@ -554,6 +765,8 @@ struct aircraft *ModeSDecoder::createNewAircraft(uint32_t addr) {
     a->vert_rate_sign = 0 ;
     a->vert_rate = 0 ;
     a->track = 0;
+    a->squawk = 0;
+    a->emergency = 0;
     a->odd_cprlat = 0;
     a->odd_cprlon = 0;
     a->odd_cprtime = 0;
@@ -564,8 +777,13 @@ struct aircraft *ModeSDecoder::createNewAircraft(uint32_t addr) {
     a->lon = 0;
     a->seen = getTimeStamp() ;
     a->messages = 0;
+    a->signal_power = 0;
     a->next = NULL;
     a->position_valid = false ;
+    a->position_time = 0;
+    a->position_rejects = 0;
+    a->history = history_pool.alloc();
+    kalmanInit(&a->kalman);
 #ifdef _WIN32
     a->mutex = createMutex();
 #else
@@ -646,14 +864,28 @@ int ModeSDecoder::bruteForceAP(unsigned char *msg, struct modesMessage *mm) {
 }
 
 
+/* Bit positions of a frame, the least confident first when the framer
+ * gave the confidences, else in frame order. */
+static void bitsByConfidence(const uint8_t *confidence, int bits, int *order) {
+    for (int j = 0; j < bits; j++)
+        order[j] = j;
+    if (confidence != nullptr)
+        std::stable_sort(order, order + bits,
+                         [confidence](int a, int b) { return confidence[a] < confidence[b]; });
+}
+
 /* Try to fix single bit errors using the checksum. On success modifies
  * the original buffer with the fixed version, and returns the position
- * of the error bit. Otherwise if fixing failed -1 is returned. */
-int ModeSDecoder::fixSingleBitErrors(unsigned char *msg, int bits) {
-    int j;
+ * of the error bit. Otherwise if fixing failed -1 is returned.
+ * The least confident bits are tried first. */
+int ModeSDecoder::fixSingleBitErrors(unsigned char *msg, int bits, const uint8_t *confidence) {
+    int k;
+    int order[MODES_LONG_MSG_BITS];
     unsigned char aux[MODES_LONG_MSG_BITS/8];
 
-    for (j = 0; j < bits; j++) {
+    bitsByConfidence(confidence, bits, order);
+    for (k = 0; k < bits; k++) {
+        int j = order[k];
         int byte = j/8;
         int bitmask = 1 << (7-(j%8));
         uint32_t crc1, crc2;
@@ -697,19 +929,28 @@ int ModeSDecoder::decodeAC12Field(unsigned char *msg, int *unit) {
 }
 
 
-/* Similar to fixSingleBitErrors() but try every possible two bit combination.
- * This is very slow and should be tried only against DF17 messages that
- * don't pass the checksum, and only in Aggressive Mode. */
-int ModeSDecoder::fixTwoBitsErrors(unsigned char *msg, int bits) {
-    int j, i;
+/* Similar to fixSingleBitErrors() but try two bit combinations.
+ * This is slow and should be tried only against DF17 messages that
+ * don't pass the checksum, and only in Aggressive Mode. With the bit
+ * confidences, only the pairs of the MODES_REPAIR_WEAK_BITS least
+ * confident bits are tried : 120 checksums instead of 6216, and far
+ * fewer wrong frames passing by chance. */
+int ModeSDecoder::fixTwoBitsErrors(unsigned char *msg, int bits, const uint8_t *confidence) {
+    int k1, k2;
+    int order[MODES_LONG_MSG_BITS];
     unsigned char aux[MODES_LONG_MSG_BITS/8];
-
-    for (j = 0; j < bits; j++) {
-        int byte1 = j/8;
-        int bitmask1 = 1 << (7-(j%8));
-
-        /* Don't check the same pairs multiple times, so i starts from j+1 */
-        for (i = j+1; i < bits; i++) {
+    int candidates = bits;
+
+    bitsByConfidence(confidence, bits, order);
+    if (confidence != nullptr && candidates > MODES_REPAIR_WEAK_BITS)
+        candidates = MODES_REPAIR_WEAK_BITS;
+    for (k1 = 0; k1 < candidates; k1++) {
+        /* Don't check the same pairs multiple times, so k2 starts from k1+1 */
+        for (k2 = k1+1; k2 < candidates; k2++) {
+            int j = std::min(order[k1], order[k2]);
+            int i = std::max(order[k1], order[k2]);
+            int byte1 = j/8;
+            int bitmask1 = 1 << (7-(j%8));
             int byte2 = i/8;
             int bitmask2 = 1 << (7-(i%8));
             uint32_t crc1, crc2;
@@ -731,7 +972,7 @@ int ModeSDecoder::fixTwoBitsErrors(unsigned char *msg, int bits) {
                 memcpy(msg,aux,bits/8);
                 /* We return the two bits as a 16 bit integer by shifting
                  * 'i' on the left. This is possible since 'i' will always
-                 * be non-zero because i starts from j+1. */
+                 * be non-zero because i is greater than j. */
                 return j | (i<<8);
             }
         }
@@ -840,8 +1081,10 @@ int ModeSDecoder::decodeAC13Field(unsigned char *msg, int *unit) {
  * 2) We assume that we always received the odd packet as last packet for
  *    simplicity. This may provide a position that is less fresh of a few
  *    seconds.
+ *
+ * Returns true if the aircraft position was updated.
  */
-void ModeSDecoder::decodeCPR(struct aircraft *a) {
+bool ModeSDecoder::decodeCPR(struct aircraft *a) {
     const double AirDlat0 = 360.0 / 60;
     const double AirDlat1 = 360.0 / 59;
     double lat0 = a->even_cprlat;
@@ -858,35 +1101,132 @@ void ModeSDecoder::decodeCPR(struct aircraft *a) {
     if (rlat1 >= 270) rlat1 -= 360;
 
     /* Check that both are in the same latitude zone, or abort. */
-    if (cprNLFunction(rlat0) != cprNLFunction(rlat1)) return;
+    if (cprNLFunction(rlat0) != cprNLFunction(rlat1)) return false;
 
     /* Compute ni and the longitude index m */
+    double lat, lon;
     if (a->even_cprtime > a->odd_cprtime) {
         /* Use even packet. */
         int ni = cprNFunction(rlat0,0);
         int m = floor((((lon0 * (cprNLFunction(rlat0)-1)) -
                         (lon1 * cprNLFunction(rlat0))) / 131072) + 0.5);
-        a->lon = cprDlonFunction(rlat0,0) * (cprModFunction(m,ni)+lon0/131072);
-        a->lat = rlat0;
-        a->position_valid = true ;
+        lon = cprDlonFunction(rlat0,0) * (cprModFunction(m,ni)+lon0/131072);
+        lat = rlat0;
     } else {
         /* Use odd packet. */
         int ni = cprNFunction(rlat1,1);
         int m = floor((((lon0 * (cprNLFunction(rlat1)-1)) -
                         (lon1 * cprNLFunction(rlat1))) / 131072.0) + 0.5);
-        a->lon = cprDlonFunction(rlat1,1) * (cprModFunction(m,ni)+lon1/131072);
-        a->lat = rlat1;
-        a->position_valid = true ;
+        lon = cprDlonFunction(rlat1,1) * (cprModFunction(m,ni)+lon1/131072);
+        lat = rlat1;
     }
-    if (a->lon > 180) a->lon -= 360;
+    if (lon > 180) lon -= 360;
+
+    /* time of the frame completing the pair */
+    uint64_t now = a->seen;
+    if (!positionIsPlausible(a, lat, lon, now)) {
+        rejected_positions++;
+        /* Drop the older half of the pair so the next position is computed
+         * from a fresh even/odd couple. */
+        if (a->even_cprtime > a->odd_cprtime)
+            a->odd_cprtime = 0;
+        else
+            a->even_cprtime = 0;
+        return false;
+    }
+    accepted_positions++;
+    a->lat = lat;
+    a->lon = lon;
+    a->position_valid = true ;
+    a->position_time = now;
+    kalmanUpdatePosition(&a->kalman, lat, lon, now);
+
+    if (a->history == nullptr) a->history = history_pool.alloc();
+    trackHistoryAppend(a->history, a->lat, a->lon, a->altitude, now);
+    return true;
+}
 
-    ADSBUpdate* msg = (ADSBUpdate *)malloc( sizeof(ADSBUpdate));
-    msg->ac = a ;
-    msg->addr = a->addr ;
-    msg->update_type = ADSBUPDATE_TYPE_AIRCRAFTMOVE ;
-    queue->add( msg );
+
+/* Great circle distance in meters between two points given in degrees. */
+static double greatCircleDistance(double lat0, double lon0, double lat1, double lon1) {
+    const double R = 6371e3;
+    double dlat = (lat1 - lat0) * M_PI / 180;
+    double dlon = (lon1 - lon0) * M_PI / 180;
+    double h = sin(dlat/2) * sin(dlat/2) +
+            cos(lat0 * M_PI / 180) * cos(lat1 * M_PI / 180) * sin(dlon/2) * sin(dlon/2);
+    return 2 * R * asin(sqrt(h < 1 ? h : 1));
 }
 
+/* Sanity check of a freshly decoded CPR position, to catch even/odd pairs
+ * mixed across a zone boundary that would make the aircraft jump by
+ * hundreds of kilometers:
+ *
+ * 1) If the receiver location is known the position must be in range.
+ * 2) If we already have a fix, the aircraft must not have moved faster
+ *    than its reported speed (with some slack) or MODES_MAX_SPEED.
+ *
+ * After MODES_MAX_POSITION_REJECTS consecutive speed rejections we assume
+ * the previous fix was the bad one and accept the new position. */
+bool ModeSDecoder::positionIsPlausible(struct aircraft *a, double lat, double lon, uint64_t now) {
+    if (receiver_valid &&
+            greatCircleDistance(receiver_lat, receiver_lon, lat, lon) > receiver_range) {
+        return false;
+    }
+    if (!a->position_valid) return true;
+
+    double max_speed = MODES_MAX_SPEED;
+    if (a->speed > 0 && a->speed * 1.5 + 100 < max_speed) max_speed = a->speed * 1.5 + 100;
+    double elapsed = (now - a->position_time) / 1000.0;
+    double max_distance = MODES_POSITION_SLACK + max_speed * 0.514444 * elapsed;
+
+    if (greatCircleDistance(a->lat, a->lon, lat, lon) <= max_distance) {
+        a->position_rejects = 0;
+        return true;
+    }
+    if (++a->position_rejects >= MODES_MAX_POSITION_REJECTS) {
+        a->position_rejects = 0;
+        return true;
+    }
+    return false;
+}
+
+/* Set the receiver location used to discard out of range positions.
+ * A range of 0 disables the check. */
+void ModeSDecoder::setReceiverLocation(double lat, double lon, double range_km) {
+    receiver_lat = lat;
+    receiver_lon = lon;
+    receiver_range = range_km * 1000;
+    receiver_valid = range_km > 0;
+}
+
+void ModeSDecoder::getStats(ModeSStats *stats) {
+    stats->messages = valid_messages;
+    stats->accepted_positions = accepted_positions;
+    stats->rejected_positions = rejected_positions;
+    stats->repaired = repair_counters.repaired;
+    stats->repair_failed = repair_counters.failed;
+    stats->repair_shed = repair_counters.shed;
+}
+
+/* Copy the aircraft list to the snapshot read by the other threads, at most
+ * every SNAPSHOT_INTERVAL ms. Decoder thread only : it is the one changing
+ * the list, so it walks it without locking. */
+void ModeSDecoder::publishSnapshot(uint64_t now) {
+    if (now - snapshot_time < SNAPSHOT_INTERVAL) return;
+    snapshot_time = now;
+
+    AircraftState *table = aircraft_snapshot->beginUpdate();
+    int max = aircraft_snapshot->capacity();
+    int count = 0;
+    for (struct aircraft *a = aircrafts; a && count < max; a = a->next) {
+        copyState(&table[count++], a);
+    }
+    aircraft_snapshot->endUpdate(count, now);
+}
+
+AircraftSnapshot *ModeSDecoder::snapshot() {
+    return aircraft_snapshot;
+}
 
 /* Always positive MOD operation, used for CPR decoding. */
 int ModeSDecoder::cprModFunction(int a, int b) {
@@ -51,8 +51,16 @@
 #include <windows.h>
 #endif
 #include <semaphore.h>
+#include <mutex>
+#include <atomic>
 
+#include "ConsumerProducer.h"
 #include "adsbframer.h"
+#include "trackhistory.h"
+#include "kalmantracker.h"
+#include "framerepair.h"
+
+class AircraftSnapshot ;
 
 #define MODES_PREAMBLE_US 8       /* microseconds */
 #define MODES_LONG_MSG_BITS 112
@@ -63,6 +71,7 @@
 
 #define MODES_ICAO_CACHE_LEN 1024 /* Power of two required. */
 #define MODES_ICAO_CACHE_TTL 60   /* Time to live of cached addresses. */
+#define MODES_REPAIR_WEAK_BITS 16 /* Two bit repair only flips the least confident ones. */
 #define MODES_UNIT_FEET 0
 #define MODES_UNIT_METERS 1
 
@@ -82,6 +91,11 @@
 #define MODES_INTERACTIVE_ROWS 15               /* Rows on screen */
 #define MODES_INTERACTIVE_TTL 60                /* TTL before being removed */
 
+#define MODES_MAX_RANGE 500             /* Default receiver range, km. */
+#define MODES_MAX_SPEED 1000            /* Knots, used when speed is unknown. */
+#define MODES_POSITION_SLACK 2000       /* Meters allowed on top of the speed check. */
+#define MODES_MAX_POSITION_REJECTS 4    /* Consecutive rejects before we trust the new fix. */
+
 /* The struct we use to store information about a decoded message. */
 struct modesMessage {
     /* Generic fields */
@@ -93,6 +107,8 @@ struct modesMessage {
     int errorbit;               /* Bit corrected. -1 if no bit corrected. */
     int aa1, aa2, aa3;          /* ICAO Address bytes 1 2 and 3 */
     int phase_corrected;        /* True if phase correction was applied. */
+    float rssi;                 /* Signal level, dBFS. */
+    uint64_t time;              /* ms elapsed since epoch at which the frame was received. */
 
     /* DF 11 */
     int ca;                     /* Responder capabilities. */
@@ -123,6 +139,9 @@ struct modesMessage {
     int um;                     /* Request extraction of downlink request. */
     int identity;               /* 13 bits identity (Squawk). */
 
+    /* DF 17 type 28 */
+    int emergency;              /* Emergency / priority status. */
+
     /* Fields used by multiple message types. */
     int altitude, unit;
 };
@@ -146,8 +165,11 @@ struct aircraft {
     int vert_rate_sign;         /* Vertical rate sign. */
     int vert_rate;              /* Vertical rate. */
     int track;          /* Angle of flight. */
+    int squawk;         /* Mode A identity, from DF5 / DF21. */
+    int emergency;      /* Emergency state, from DF17 type 28. */
     uint64_t seen;        /* ms elapsed since epoch at which the last packet was received. */
     long messages;      /* Number of Mode S messages received. */
+    double signal_power;    /* Mean power of the recent messages, 1 = full scale. */
     /* Encoded latitude and longitude as extracted by odd and even
      * CPR encoded messages. */
     int odd_cprlat;
@@ -156,7 +178,11 @@ struct aircraft {
     int even_cprlon;
     bool position_valid ;
     double lat, lon;    /* Coordinated obtained from CPR encoded data. */
+    uint64_t position_time; /* ms elapsed since epoch of the last accepted fix. */
+    int position_rejects;   /* Consecutive implausible positions. */
     long long odd_cprtime, even_cprtime;
+    TrackHistory *history; /* Trail ring, nullptr if the pool is exhausted. */
+    KalmanTrack kalman;    /* Position / velocity tracking filter. */
     struct aircraft *next; /* Next aircraft in our linked list. */
     P_MUTEX mutex ;
 };
@@ -165,28 +191,84 @@ struct aircraft {
 #define ADSBUPDATE_TYPE_AIRCRAFTMOVE (1)
 #define ADSBUPDATE_TYPE_AIRCRAFTLOST (2)
 
+/* What changed in an update, ORed together. */
+#define ADSBUPDATE_CHANGE_ALTITUDE (1<<0)
+#define ADSBUPDATE_CHANGE_POSITION (1<<1)
+#define ADSBUPDATE_CHANGE_VELOCITY (1<<2)
+#define ADSBUPDATE_CHANGE_FLIGHT (1<<3)
+#define ADSBUPDATE_CHANGE_SQUAWK (1<<4)
+#define ADSBUPDATE_CHANGE_EMERGENCY (1<<5)
+#define ADSBUPDATE_CHANGE_ALL (0x3f)
+
+/* Copy of the published fields of struct aircraft. Updates carry it by
+ * value so they stay valid whatever happens to the aircraft afterwards. */
+typedef struct {
+    uint32_t addr;
+    char flight[9];
+    int altitude;
+    int speed;
+    int vert_rate_sign;
+    int vert_rate;
+    int track;
+    int squawk;
+    int emergency;
+    bool position_valid;
+    double rssi;        /* dBFS to 0.1 dB, recent messages */
+    double lat, lon;
+    uint64_t position_time;
+    uint64_t seen;
+    long messages;
+} AircraftState ;
+
 typedef struct {
     uint32_t addr;      /* ICAO address */
     uint8_t  update_type ;
-    struct aircraft *ac ;
+    uint16_t changes ;  /* ADSBUPDATE_CHANGE_xxx, 0 for lost aircraft */
+    AircraftState state ;
 } ADSBUpdate ;
 
 typedef ConsumerProducerQueue<ADSBUpdate *> ADSBUpdateQueue ;
 
+/* ms elapsed since epoch */
+uint64_t getTimeStamp() ;
+
+typedef struct {
+    uint64_t messages ;             /* frames with a valid CRC */
+    uint64_t accepted_positions ;
+    uint64_t rejected_positions ;   /* CPR decodes failing the plausibility check */
+    uint64_t repaired ;             /* two bit errors fixed by the repair pool */
+    uint64_t repair_failed ;
+    uint64_t repair_shed ;          /* not tried, the pool was too far behind */
+} ModeSStats ;
+
 class ModeSDecoder
 {
 public:
 
     ModeSDecoder();
-    void pushRawMSG( ADSBRawMSG *msg );
+    ~ModeSDecoder();
+    bool pushRawMSG( ADSBRawMSG *msg );
     bool hasMSG();
     ADSBUpdate* popMSG();
 
+    int getTrail( uint32_t addr, TrackPoint *points, int max_points, uint64_t *base );
+    bool predictPosition( uint32_t addr, uint64_t at, double *lat, double *lon, int *altitude );
+    void setReceiverLocation( double lat, double lon, double range_km );
+    void getStats( ModeSStats *stats );
+    bool setRepairThreads( int threads );
+    ADSBRawMSG *popRepaired();
+
+    void publishSnapshot( uint64_t now );
+    AircraftSnapshot *snapshot();
+
 private:
     ADSBUpdateQueue *queue ;
     int metric;                     /* Use metric units. */
     int aggressive;                 /* Aggressive detection algorithm. */
     int fix_errors;                 /* Single bit error correction if true. */
+    int repair_threads;             /* Two bit error correction, inline if 0. */
+    FrameRepairPool *repair_pool;   /* Created by the first frame to repair. */
+    RepairCounters repair_counters; /* Of all the pools, read by getStats(). */
     uint32_t *icao_cache;           /* Recently seen ICAO addresses cache. */
     int check_crc;                  /* Only display messages with good CRC. */
 
@@ -194,9 +276,31 @@ private:
     struct aircraft *aircrafts;
     long long interactive_last_update;  /* Last screen update in milliseconds */
 
-    uint32_t modesChecksum(unsigned char *msg, int bits) ;
-    int fixSingleBitErrors(unsigned char *msg, int bits) ;
-    int fixTwoBitsErrors(unsigned char *msg, int bits);
+    /* The decoder thread is the only one changing the list, so it only
+     * takes this lock to link / unlink aircrafts. Other threads hold it
+     * while they look into the list. */
+    std::mutex aircrafts_lock;
+    TrackHistoryPool history_pool;
+    AircraftSnapshot *aircraft_snapshot;
+    uint64_t snapshot_time;
+
+    /* Position plausibility check */
+    bool receiver_valid;
+    double receiver_lat, receiver_lon;
+    double receiver_range;          /* meters */
+    std::atomic<uint64_t> valid_messages;
+    std::atomic<uint64_t> accepted_positions;
+    std::atomic<uint64_t> rejected_positions;
+
+    /* Frame timestamps to ms : newest frame of each receiver, 12 MHz
+     * ticks and the ms at which it was decoded. */
+    uint64_t clock_ticks[ADSB_MAX_RECEIVERS];
+    uint64_t clock_ms[ADSB_MAX_RECEIVERS];
+    uint64_t frameTime(const ADSBRawMSG *msg);
+
+    static uint32_t modesChecksum(unsigned char *msg, int bits) ;
+    int fixSingleBitErrors(unsigned char *msg, int bits, const uint8_t *confidence) ;
+    static int fixTwoBitsErrors(unsigned char *msg, int bits, const uint8_t *confidence);
     int bruteForceAP(unsigned char *msg, struct modesMessage *mm) ;
     int ICAOAddressWasRecentlySeen(uint32_t addr) ;
     void addRecentlySeenICAOAddr(uint32_t addr) ;
@@ -205,14 +309,17 @@ private:
     int decodeAC13Field(unsigned char *msg, int *unit) ;
     int decodeAC12Field(unsigned char *msg, int *unit) ;
 
-    void decodeCPR(struct aircraft *a) ;
+    bool decodeCPR(struct aircraft *a) ;
+    void queueUpdate(struct aircraft *a, uint8_t update_type, uint16_t changes) ;
+    void copyState(AircraftState *st, struct aircraft *a) ;
+    bool positionIsPlausible(struct aircraft *a, double lat, double lon, uint64_t now) ;
     double cprDlonFunction(double lat, int isodd) ;
     int cprNFunction(double lat, int isodd) ;
     int cprNLFunction(double lat) ;
     int cprModFunction(int a, int b) ;
 
     struct aircraft *processReceivedData(struct modesMessage *mm) ;
-    void decodeModesMessage(struct modesMessage *mm, unsigned char *msg, int len_msg ) ;
+    void decodeModesMessage(struct modesMessage *mm, unsigned char *msg, int len_msg, const uint8_t *confidence ) ;
     struct aircraft *findAircraft(uint32_t addr) ;
     struct aircraft *createNewAircraft(uint32_t addr) ;
     void removeStaleAircrafts(void) ;
@@ -0,0 +1,201 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "multicastpublisher.h"
+#include "binaryupdatequeue.h"
+
+static_assert( sizeof(ADSBMulticastHeader) == 16, "adsbmulticast.h header layout" );
+
+MulticastPublisher::MulticastPublisher() {
+    running = false ;
+    content = 0 ;
+    sock = -1 ;
+    event_fd = eventfd( 0, EFD_CLOEXEC );
+    sender = nullptr ;
+    pool = new Datagram[MULTICAST_DATAGRAMS] ;
+    ready = new SPSCQueue<Datagram *>( MULTICAST_DATAGRAMS );
+    empty = new SPSCQueue<Datagram *>( MULTICAST_DATAGRAMS );
+    for( int i = 0 ; i < MULTICAST_DATAGRAMS ; i++ ) {
+        empty->push( &pool[i] );
+    }
+    current[0] = current[1] = current[2] = nullptr ;
+    seq = 0 ;
+    dropped = 0 ;
+    overflow = false ;
+}
+
+MulticastPublisher::~MulticastPublisher() {
+    stop();
+    if( event_fd >= 0 ) close( event_fd );
+    delete ready ;
+    delete empty ;
+    delete[] pool ;
+}
+
+// content : MULTICAST_FRAMES and/or MULTICAST_UPDATES
+bool MulticastPublisher::start( const char *group, int port, int ttl, int content ) {
+    if( running || (event_fd < 0) )
+        return( false );
+
+    memset( &addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET ;
+    addr.sin_port = htons( (uint16_t)port );
+    if( inet_pton( AF_INET, group, &addr.sin_addr ) != 1 )
+        return( false );
+
+    sock = socket( AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0 );
+    if( sock < 0 )
+        return( false );
+    unsigned char c = (unsigned char)ttl ;
+    setsockopt( sock, IPPROTO_IP, IP_MULTICAST_TTL, &c, sizeof(c));
+    c = 1 ;     // local receivers see the datagrams too
+    setsockopt( sock, IPPROTO_IP, IP_MULTICAST_LOOP, &c, sizeof(c));
+
+    this->content = content ;
+    running = true ;
+    sender = new std::thread( senderThread, this );
+    return( true );
+}
+
+void MulticastPublisher::stop() {
+    if( sender != nullptr ) {
+        running = false ;
+        uint64_t one = 1 ;
+        if( write( event_fd, &one, sizeof(one)) < 0 ) {
+            // cannot fail before 2^64 - 1 writes
+        }
+        sender->join();
+        delete sender ;
+        sender = nullptr ;
+    }
+    running = false ;
+    Datagram *d ;
+    while( ready->pop( d )) {
+        empty->push( d );
+    }
+    if( sock >= 0 ) {
+        close( sock );
+        sock = -1 ;
+    }
+}
+
+bool MulticastPublisher::isRunning() {
+    return( running );
+}
+
+// records lost because the sender thread had no free datagram left
+uint64_t MulticastPublisher::droppedRecords() {
+    return( dropped );
+}
+
+// room for one more record in the datagram of this type, nullptr if none
+uint8_t *MulticastPublisher::reserve( int type, size_t len ) {
+    Datagram *d = current[type] ;
+    if( (d != nullptr) && (d->len + len > ADSB_MCAST_MAX_PAYLOAD) ) {
+        send( type );
+        d = nullptr ;
+    }
+    if( d == nullptr ) {
+        if( !empty->pop( d )) {
+            dropped++ ;
+            overflow = true ;
+            return( nullptr );
+        }
+        ADSBMulticastHeader *h = (ADSBMulticastHeader *)d->data ;
+        h->magic = ADSB_MCAST_MAGIC ;
+        h->version = ADSB_MCAST_VERSION ;
+        h->type = (uint8_t)type ;
+        h->count = 0 ;
+        h->reserved = 0 ;
+        d->len = sizeof(ADSBMulticastHeader) ;
+        current[type] = d ;
+    }
+    uint8_t *p = d->data + d->len ;
+    d->len += len ;
+    ((ADSBMulticastHeader *)d->data)->count++ ;
+    return( p );
+}
+
+void MulticastPublisher::send( int type ) {
+    Datagram *d = current[type] ;
+    if( overflow ) {
+        // leave a hole in the sequence so receivers see the loss
+        seq++ ;
+        overflow = false ;
+    }
+    ((ADSBMulticastHeader *)d->data)->seq = seq++ ;
+    // cannot fail, the queue holds the whole pool
+    ready->push( d );
+    current[type] = nullptr ;
+}
+
+void MulticastPublisher::pushFrame( const ADSBRawMSG *msg ) {
+    if( !running || !(content & MULTICAST_FRAMES) )
+        return ;
+    int bytes = (msg->len - 1) / 8 ;
+    uint8_t *p = reserve( ADSB_MCAST_FRAMES, sizeof(ADSBMulticastFrame) + bytes );
+    if( p == nullptr )
+        return ;
+    ADSBMulticastFrame *f = (ADSBMulticastFrame *)p ;
+    f->timestamp = msg->timestamp ;
+    f->signal = msg->signal ;
+    f->receiver = msg->receiver ;
+    f->len = (uint8_t)bytes ;
+    memcpy( p + sizeof(ADSBMulticastFrame), msg->msg, bytes );
+}
+
+void MulticastPublisher::pushUpdate( ADSBUpdate *msg ) {
+    if( !running || !(content & MULTICAST_UPDATES) )
+        return ;
+    uint8_t *p = reserve( ADSB_MCAST_UPDATES, sizeof(ADSBBinaryUpdate) );
+    if( p == nullptr )
+        return ;
+    encodeBinaryUpdate( (ADSBBinaryUpdate *)p, msg );
+}
+
+// end of block : hand over the partial datagrams too
+void MulticastPublisher::publish() {
+    bool sent = false ;
+    for( int type = ADSB_MCAST_FRAMES ; type <= ADSB_MCAST_UPDATES ; type++ ) {
+        if( current[type] != nullptr ) {
+            send( type );
+            sent = true ;
+        }
+    }
+    if( sent ) {
+        uint64_t one = 1 ;
+        if( write( event_fd, &one, sizeof(one)) < 0 ) {
+            // cannot fail before 2^64 - 1 writes
+        }
+    }
+}
+
+void MulticastPublisher::senderThread( MulticastPublisher *p ) {
+    p->run();
+}
+
+void MulticastPublisher::run() {
+    while( running ) {
+        uint64_t count ;
+        if( read( event_fd, &count, sizeof(count)) < 0 )
+            continue ;
+        Datagram *d ;
+        while( ready->pop( d )) {
+            sendto( sock, d->data, d->len, 0, (struct sockaddr *)&addr, sizeof(addr));
+            empty->push( d );
+        }
+    }
+}
@@ -0,0 +1,81 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef MULTICASTPUBLISHER_H
+#define MULTICASTPUBLISHER_H
+
+#include <stdint.h>
+#include <thread>
+#include <atomic>
+#include <netinet/in.h>
+#include "adsbmulticast.h"
+#include "adsbframer.h"
+#include "modesdecoder.h"
+#include "spscqueue.h"
+
+#define MULTICAST_DATAGRAMS 256     /* datagram buffers shared by the two threads */
+#define MULTICAST_FRAMES 1
+#define MULTICAST_UPDATES 2
+
+/* MulticastPublisher : sends frames and updates as UDP multicast datagrams
+ * described in adsbmulticast.h.
+ *
+ * decode_thread packs the records into datagrams of at most one MTU and hands
+ * the full ones, and the partial ones at the end of each block, to a sender
+ * thread through a lock-free queue. The sender only sleeps on an eventfd
+ * between two blocks. Datagram buffers come back through a
+ * second queue, so nothing is allocated once started. When no buffer is
+ * free the records are dropped, decode_thread never waits for the network.
+ */
+class MulticastPublisher
+{
+public:
+    MulticastPublisher();
+    ~MulticastPublisher();
+
+    bool start( const char *group, int port, int ttl, int content );
+    void stop();
+    bool isRunning();
+
+    // decode_thread side
+    void pushFrame( const ADSBRawMSG *msg );
+    void pushUpdate( ADSBUpdate *msg );
+    void publish();
+
+    uint64_t droppedRecords();
+
+private:
+    typedef struct {
+        size_t len ;
+        uint8_t data[ADSB_MCAST_MAX_PAYLOAD] ;
+    } Datagram ;
+
+    std::atomic<bool> running ;
+    int content ;
+    int sock ;
+    int event_fd ;
+    std::thread *sender ;
+
+    Datagram *pool ;
+    SPSCQueue<Datagram *> *ready ;      /* decode_thread -> sender */
+    SPSCQueue<Datagram *> *empty ;      /* sender -> decode_thread */
+    Datagram *current[3] ;              /* being filled, by type */
+    struct sockaddr_in addr ;
+    uint32_t seq ;
+    bool overflow ;                     /* records dropped since the last datagram */
+    std::atomic<uint64_t> dropped ;
+
+    uint8_t *reserve( int type, size_t len );
+    void send( int type );
+    static void senderThread( MulticastPublisher *p );
+    void run();
+};
+
+#endif // MULTICASTPUBLISHER_H
@@ -0,0 +1,121 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef PIPELINEQUEUE_H
+#define PIPELINEQUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include "spscqueue.h"
+
+/* PipelineSignal : lets the consumer of one or more queues sleep while
+ * they are all empty. The mutex is only taken when the consumer found
+ * nothing and went to sleep : while items keep coming, both sides only
+ * touch the rings.
+ */
+class PipelineSignal
+{
+public:
+    PipelineSignal() {
+        sleeping = false ;
+    }
+
+    // producer side, after each push
+    void notify() {
+        // orders the push before reading 'sleeping', see wait()
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if( sleeping.load( std::memory_order_relaxed )) {
+            std::lock_guard<std::mutex> lock( mutex );
+            cond.notify_one();
+        }
+    }
+
+    // consumer side, sleeps until ready() is true or timeout_ms elapsed
+    template<typename F>
+    bool wait( F ready, int timeout_ms ) {
+        if( ready() )
+            return( true );
+        std::unique_lock<std::mutex> lock( mutex );
+        sleeping.store( true, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        // a push done before the fence is seen here, one done after it
+        // sees 'sleeping' and waits for the mutex to notify
+        bool found = ready();
+        if( !found ) {
+            cond.wait_for( lock, std::chrono::milliseconds( timeout_ms ));
+            found = ready();
+        }
+        sleeping.store( false, std::memory_order_relaxed );
+        return( found );
+    }
+
+private:
+    std::mutex mutex ;
+    std::condition_variable cond ;
+    std::atomic<bool> sleeping ;
+};
+
+/* PipelineQueue : link between two stages of the receive pipeline.
+ *
+ * A SPSCQueue the consumer can also sleep on. The producer never waits :
+ * when the queue is full push() fails and counts the item as dropped, so a
+ * slow stage loses its own input instead of stalling the ones before it.
+ *
+ * Queues with the same consumer may share one signal, it then waits for
+ * any of them.
+ */
+template<typename T>
+class PipelineQueue
+{
+public:
+    PipelineQueue( int capacity, PipelineSignal *shared = nullptr ) : ring( capacity ) {
+        signal = shared != nullptr ? shared : &own_signal ;
+        dropped = 0 ;
+    }
+
+    // producer side
+    bool push( const T& item ) {
+        if( !ring.push( item )) {
+            dropped++ ;
+            return( false );
+        }
+        signal->notify();
+        return( true );
+    }
+
+    // consumer side, never blocks
+    bool pop( T& item ) {
+        return( ring.pop( item ));
+    }
+
+    bool isEmpty() const {
+        return( ring.isEmpty() );
+    }
+
+    // consumer side, sleeps until an item comes or timeout_ms elapsed
+    bool wait( T& item, int timeout_ms ) {
+        return( signal->wait( [this, &item]() { return ring.pop( item ); }, timeout_ms ));
+    }
+
+    uint64_t droppedItems() {
+        return( dropped );
+    }
+
+private:
+    SPSCQueue<T> ring ;
+    PipelineSignal own_signal ;
+    PipelineSignal *signal ;
+    std::atomic<uint64_t> dropped ;
+};
+
+#endif // PIPELINEQUEUE_H
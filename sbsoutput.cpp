@@ -0,0 +1,204 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "sbsoutput.h"
+
+/* Data fields 11 to 18 of a line */
+#define SBS_CALLSIGN  (1<<0)
+#define SBS_ALTITUDE  (1<<1)
+#define SBS_SPEED     (1<<2)
+#define SBS_TRACK     (1<<3)
+#define SBS_LAT       (1<<4)
+#define SBS_LON       (1<<5)
+#define SBS_VERT_RATE (1<<6)
+#define SBS_SQUAWK    (1<<7)
+
+static const uint32_t sbs_template[] = {
+    0,
+    SBS_CALLSIGN,                               /* MSG,1 identification */
+    SBS_ALTITUDE | SBS_SPEED | SBS_TRACK | SBS_LAT | SBS_LON,   /* MSG,2 surface position */
+    SBS_ALTITUDE | SBS_LAT | SBS_LON,           /* MSG,3 airborne position */
+    SBS_SPEED | SBS_TRACK | SBS_VERT_RATE,      /* MSG,4 airborne velocity */
+    SBS_ALTITUDE,                               /* MSG,5 surveillance altitude */
+    SBS_ALTITUDE | SBS_SQUAWK,                  /* MSG,6 surveillance identity */
+};
+
+static inline char *putString( char *p, const char *s, size_t len ) {
+    memcpy( p, s, len );
+    return( p + len );
+}
+
+static inline char *putInt( char *p, int64_t x ) {
+    char tmp[24] ;
+    int n = sizeof(tmp) ;
+    uint64_t u = x < 0 ? 0 - (uint64_t)x : (uint64_t)x ;
+    do {
+        tmp[--n] = '0' + (u % 10) ;
+        u /= 10 ;
+    } while( u != 0 );
+    if( x < 0 )
+        tmp[--n] = '-' ;
+    return( putString( p, tmp + n, sizeof(tmp) - n ));
+}
+
+// fixed 5 decimals, enough for about 1 meter
+static inline char *putDegrees( char *p, double x ) {
+    int64_t v = llround( x * 1e5 );
+    if( v < 0 ) {
+        *p++ = '-' ;
+        v = -v ;
+    }
+    p = putInt( p, v / 100000 );
+    *p++ = '.' ;
+    int frac = (int)(v % 100000) ;
+    for( int d = 10000 ; d > 0 ; d /= 10 ) {
+        *p++ = '0' + (frac / d) % 10 ;
+    }
+    return( p );
+}
+
+static inline char *put2( char *p, int x ) {
+    *p++ = '0' + (x / 10) % 10 ;
+    *p++ = '0' + x % 10 ;
+    return( p );
+}
+
+SBSEncoder::SBSEncoder() {
+    times_len = 0 ;
+    day_start = 0 ;
+    date[0] = 0 ;
+}
+
+// formats the date and time fields shared by all the lines of a block
+void SBSEncoder::setTime( uint64_t now ) {
+    if( (now < day_start) || (now - day_start >= 24*3600*1000ULL) ) {
+        // new day (or first call) : localtime() only runs here
+        time_t t = (time_t)(now / 1000) ;
+        struct tm tm ;
+        localtime_r( &t, &tm );
+        int year = tm.tm_year + 1900 ;
+        if( year < 0 ) year = 0 ;
+        if( year > 9999 ) year = 9999 ;
+        char *d = date ;
+        d = put2( d, year / 100 );
+        d = put2( d, year % 100 );
+        *d++ = '/' ;
+        d = put2( d, tm.tm_mon + 1 );
+        *d++ = '/' ;
+        d = put2( d, tm.tm_mday );
+        *d = 0 ;
+        uint64_t since_midnight = (tm.tm_hour*3600 + tm.tm_min*60 + tm.tm_sec) * 1000ULL + now % 1000 ;
+        day_start = now - since_midnight ;
+    }
+    uint64_t ms = now - day_start ;
+    char time[16] ;
+    char *p = time ;
+    p = put2( p, (int)(ms / 3600000) );
+    *p++ = ':' ;
+    p = put2( p, (int)(ms / 60000 % 60) );
+    *p++ = ':' ;
+    p = put2( p, (int)(ms / 1000 % 60) );
+    *p++ = '.' ;
+    *p++ = '0' + (ms / 100) % 10 ;
+    p = put2( p, (int)(ms % 100) );
+    size_t time_len = p - time ;
+
+    // generated and logged times are the same
+    size_t date_len = strlen( date );
+    p = times ;
+    for( int i = 0 ; i < 2 ; i++ ) {
+        *p++ = ',' ;
+        p = putString( p, date, date_len );
+        *p++ = ',' ;
+        p = putString( p, time, time_len );
+    }
+    times_len = p - times ;
+}
+
+char *SBSEncoder::line( char *p, int type, uint32_t fields, const AircraftState *ac ) {
+    static const char hex[] = "0123456789ABCDEF" ;
+    uint32_t t = sbs_template[type] & fields ;
+
+    p = putString( p, "MSG,", 4 );
+    *p++ = '0' + type ;
+    p = putString( p, ",1,1,", 5 );
+    for( int shift = 20 ; shift >= 0 ; shift -= 4 ) {
+        *p++ = hex[(ac->addr >> shift) & 15] ;
+    }
+    p = putString( p, ",1", 2 );
+    p = putString( p, times, times_len );
+
+    *p++ = ',' ;
+    if( t & SBS_CALLSIGN ) p = putString( p, ac->flight, strlen( ac->flight ));
+    *p++ = ',' ;
+    if( t & SBS_ALTITUDE ) p = putInt( p, ac->altitude );
+    *p++ = ',' ;
+    if( t & SBS_SPEED ) p = putInt( p, ac->speed );
+    *p++ = ',' ;
+    if( t & SBS_TRACK ) p = putInt( p, ac->track );
+    *p++ = ',' ;
+    if( t & SBS_LAT ) p = putDegrees( p, ac->lat );
+    *p++ = ',' ;
+    if( t & SBS_LON ) p = putDegrees( p, ac->lon );
+    *p++ = ',' ;
+    if( (t & SBS_VERT_RATE) && (ac->vert_rate > 0) ) {
+        // 64 fpm steps, 0 means no information
+        int rate = (ac->vert_rate - 1) * 64 ;
+        p = putInt( p, ac->vert_rate_sign ? -rate : rate );
+    }
+    *p++ = ',' ;
+    if( t & SBS_SQUAWK ) p = putInt( p, ac->squawk );
+
+    // alert, emergency, SPI, on ground
+    bool emergency = (ac->emergency != 0) || (ac->squawk == 7500) ||
+                     (ac->squawk == 7600) || (ac->squawk == 7700) ;
+    if( emergency ) {
+        p = putString( p, ",0,-1,0,0\r\n", 11 );
+    } else {
+        p = putString( p, ",0,0,0,0\r\n", 10 );
+    }
+    return( p );
+}
+
+// lines for the items of an update that changed, returns their total length
+size_t SBSEncoder::encode( ADSBUpdate *msg, char *out ) {
+    const AircraftState *ac = &msg->state ;
+    char *p = out ;
+    uint16_t changes = msg->changes ;
+
+    if( msg->update_type == ADSBUPDATE_TYPE_AIRCRAFTLOST )
+        return( 0 );
+
+    uint32_t fields = ~0u ;
+    if( msg->update_type == ADSBUPDATE_TYPE_NEWAIRCRAFT ) {
+        // only what is known so far
+        fields = 0 ;
+        if( ac->flight[0] ) fields |= SBS_CALLSIGN ;
+        if( ac->altitude ) fields |= SBS_ALTITUDE ;
+        if( ac->speed ) fields |= SBS_SPEED | SBS_TRACK | SBS_VERT_RATE ;
+        if( ac->position_valid ) fields |= SBS_LAT | SBS_LON ;
+        if( ac->squawk ) fields |= SBS_SQUAWK ;
+    }
+
+    if( (changes & ADSBUPDATE_CHANGE_FLIGHT) && (fields & SBS_CALLSIGN) )
+        p = line( p, 1, fields, ac );
+    if( (changes & ADSBUPDATE_CHANGE_POSITION) && (fields & SBS_LAT) )
+        p = line( p, 3, fields, ac );
+    else if( (changes & ADSBUPDATE_CHANGE_ALTITUDE) && (fields & SBS_ALTITUDE) )
+        p = line( p, 5, fields, ac );
+    if( (changes & ADSBUPDATE_CHANGE_VELOCITY) && (fields & SBS_SPEED) )
+        p = line( p, 4, fields, ac );
+    if( (changes & (ADSBUPDATE_CHANGE_SQUAWK | ADSBUPDATE_CHANGE_EMERGENCY)) && (fields & SBS_SQUAWK) )
+        p = line( p, 6, fields, ac );
+    return( (size_t)(p - out) );
+}
@@ -0,0 +1,50 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef SBSOUTPUT_H
+#define SBSOUTPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "modesdecoder.h"
+
+#define DEFAULT_SBS_PORT 30003
+#define SBS_LINE_MAXLEN 160
+#define SBS_UPDATE_MAXLEN (5*SBS_LINE_MAXLEN)   /* lines written for one update */
+
+/* SBSEncoder : turns decoder updates into SBS-1 BaseStation CSV lines
+ *
+ *   MSG,3,1,1,40621D,1,2021/09/11,18:45:23.042,2021/09/11,18:45:23.042,
+ *       ,38000,,,52.26578,3.93891,,,0,0,0,0
+ *
+ * One line per changed item : MSG,1 callsign, MSG,3 position, MSG,4
+ * velocity, MSG,5 altitude alone, MSG,6 squawk. Each message type has a
+ * template telling which of the data fields it fills, and the date and
+ * time fields are formatted once per setTime() call, so encoding a line
+ * is only a few copies and integer conversions.
+ */
+class SBSEncoder
+{
+public:
+    SBSEncoder();
+
+    void setTime( uint64_t now );
+    size_t encode( ADSBUpdate *msg, char *out );
+
+private:
+    char times[64] ;        /* "date,time,date,time" of the current block */
+    size_t times_len ;
+    uint64_t day_start ;    /* local midnight of the cached date, ms */
+    char date[16] ;
+
+    char *line( char *p, int type, uint32_t fields, const AircraftState *ac );
+};
+
+#endif // SBSOUTPUT_H
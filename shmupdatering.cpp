@@ -0,0 +1,91 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "shmupdatering.h"
+#include "binaryupdatequeue.h"
+
+static_assert( sizeof(ADSBShmHeader) == 128, "adsbshm.h header layout" );
+static_assert( sizeof(ADSBShmSlot) == 64, "adsbshm.h slot layout" );
+
+ShmUpdateRing::ShmUpdateRing() {
+    header = nullptr ;
+    slots = nullptr ;
+    size = 0 ;
+    mask = 0 ;
+}
+
+ShmUpdateRing::~ShmUpdateRing() {
+    close();
+}
+
+// capacity is rounded up to a power of two
+bool ShmUpdateRing::open( const char *name, int capacity ) {
+    close();
+    uint32_t slots_count = 1 ;
+    while( slots_count < (uint32_t)capacity )
+        slots_count <<= 1 ;
+
+    // start from a fresh object, readers of a previous one keep their mapping
+    shm_unlink( name );
+    int fd = shm_open( name, O_CREAT | O_EXCL | O_RDWR, 0644 );
+    if( fd < 0 )
+        return( false );
+    size = ADSB_SHM_SIZE( slots_count );
+    if( ftruncate( fd, size ) < 0 ) {
+        ::close( fd );
+        shm_unlink( name );
+        return( false );
+    }
+    void *p = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    ::close( fd );
+    if( p == MAP_FAILED ) {
+        shm_unlink( name );
+        return( false );
+    }
+
+    // ftruncate() gives zeroed memory : all slots empty, head 0
+    header = (ADSBShmHeader *)p ;
+    slots = (ADSBShmSlot *)(header + 1) ;
+    mask = slots_count - 1 ;
+    header->capacity = slots_count ;
+    header->slot_size = sizeof(ADSBShmSlot) ;
+    header->version = ADSB_SHM_VERSION ;
+    // written last, readers check it first
+    __atomic_store_n( &header->magic, ADSB_SHM_MAGIC, __ATOMIC_RELEASE );
+    this->name = name ;
+    return( true );
+}
+
+void ShmUpdateRing::close() {
+    if( header == nullptr )
+        return ;
+    munmap( header, size );
+    shm_unlink( name.c_str() );
+    header = nullptr ;
+    slots = nullptr ;
+}
+
+bool ShmUpdateRing::isOpen() {
+    return( header != nullptr );
+}
+
+void ShmUpdateRing::push( ADSBUpdate *msg ) {
+    uint64_t n = header->head ;
+    ADSBShmSlot *slot = &slots[n & mask] ;
+
+    __atomic_store_n( &slot->seq, 2 * n + 1, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    encodeBinaryUpdate( &slot->rec, msg );
+    __atomic_store_n( &slot->seq, 2 * n + 2, __ATOMIC_RELEASE );
+    __atomic_store_n( &header->head, n + 1, __ATOMIC_RELEASE );
+}
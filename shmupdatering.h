@@ -0,0 +1,42 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef SHMUPDATERING_H
+#define SHMUPDATERING_H
+
+#include <string>
+#include "adsbshm.h"
+#include "modesdecoder.h"
+
+/* ShmUpdateRing : writer side of the shared memory ring described in
+ * adsbshm.h. push() is called from decode_thread only, open() and close()
+ * while it is stopped.
+ */
+class ShmUpdateRing
+{
+public:
+    ShmUpdateRing();
+    ~ShmUpdateRing();
+
+    bool open( const char *name, int capacity );
+    void close();
+    bool isOpen();
+
+    void push( ADSBUpdate *msg );
+
+private:
+    std::string name ;
+    ADSBShmHeader *header ;
+    ADSBShmSlot *slots ;
+    size_t size ;
+    uint64_t mask ;
+};
+
+#endif // SHMUPDATERING_H
@@ -0,0 +1,72 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+
+/* SPSCQueue : bounded lock-free queue between exactly one producer thread
+ * and one consumer thread. Neither side ever blocks : push() fails when
+ * the queue is full and pop() when it is empty, the caller decides what
+ * to do. The capacity is rounded up to a power of two.
+ */
+template<typename T>
+class SPSCQueue
+{
+public:
+    SPSCQueue( int capacity ) {
+        uint32_t size = 1 ;
+        while( size < (uint32_t)capacity )
+            size <<= 1 ;
+        mask = size - 1 ;
+        ring = new T[size] ;
+        head = 0 ;
+        tail = 0 ;
+    }
+
+    ~SPSCQueue() {
+        delete[] ring ;
+    }
+
+    // producer side
+    bool push( const T& item ) {
+        uint32_t t = tail.load( std::memory_order_relaxed );
+        if( t - head.load( std::memory_order_acquire ) > mask )
+            return( false );
+        ring[t & mask] = item ;
+        tail.store( t + 1, std::memory_order_release );
+        return( true );
+    }
+
+    // consumer side
+    bool pop( T& item ) {
+        uint32_t h = head.load( std::memory_order_relaxed );
+        if( h == tail.load( std::memory_order_acquire ) )
+            return( false );
+        item = ring[h & mask] ;
+        head.store( h + 1, std::memory_order_release );
+        return( true );
+    }
+
+    bool isEmpty() const {
+        return( head.load( std::memory_order_acquire ) == tail.load( std::memory_order_acquire ) );
+    }
+
+private:
+    T *ring ;
+    uint32_t mask ;
+    alignas(64) std::atomic<uint32_t> head ;    /* written by the consumer */
+    alignas(64) std::atomic<uint32_t> tail ;    /* written by the producer */
+};
+
+#endif // SPSCQUEUE_H
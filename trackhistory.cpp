@@ -0,0 +1,92 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "trackhistory.h"
+
+TrackHistoryPool::TrackHistoryPool( int slabs ) {
+    slab_count = slabs ;
+    slab = (TrackHistory *)malloc( slab_count * sizeof(TrackHistory));
+    free_list = (int *)malloc( slab_count * sizeof(int));
+    free_count = 0 ;
+    if( slab == nullptr || free_list == nullptr ) {
+        return ;
+    }
+    // lowest slabs first, keeps the working set compact
+    for( int i = slab_count-1 ; i >= 0 ; i-- ) {
+        free_list[free_count++] = i ;
+    }
+}
+
+TrackHistoryPool::~TrackHistoryPool() {
+    free( slab );
+    free( free_list );
+}
+
+TrackHistory *TrackHistoryPool::alloc() {
+    if( free_count == 0 )
+        return( nullptr );
+    TrackHistory *h = &slab[ free_list[--free_count] ] ;
+    h->base = 0 ;
+    h->head = 0 ;
+    h->count = 0 ;
+    return( h );
+}
+
+void TrackHistoryPool::release( TrackHistory *h ) {
+    if( h == nullptr )
+        return ;
+    free_list[free_count++] = (int)(h - slab) ;
+}
+
+int TrackHistoryPool::used() {
+    return( slab_count - free_count );
+}
+
+/* Store a new position in the ring, overwriting the oldest one when full.
+ * Positions closer than TRACK_HISTORY_MIN_INTERVAL to the previous stored
+ * point are skipped so the ring covers a useful duration. */
+void trackHistoryAppend( TrackHistory *h, double lat, double lon, int altitude, uint64_t ts ) {
+    if( h == nullptr )
+        return ;
+
+    if( h->count == 0 ) {
+        h->base = ts ;
+    } else {
+        int last = (h->head + TRACK_HISTORY_LEN - 1) % TRACK_HISTORY_LEN ;
+        if( ts - (h->base + h->points[last].dt) < TRACK_HISTORY_MIN_INTERVAL )
+            return ;
+    }
+
+    TrackPoint *p = &h->points[h->head] ;
+    p->lat = (int32_t)lround( lat * 1e7 );
+    p->lon = (int32_t)lround( lon * 1e7 );
+    p->altitude = altitude ;
+    p->dt = (uint32_t)(ts - h->base) ;
+
+    h->head = (h->head + 1) % TRACK_HISTORY_LEN ;
+    if( h->count < TRACK_HISTORY_LEN )
+        h->count++ ;
+}
+
+/* Copy the trail, oldest point first. Returns the number of points copied. */
+int trackHistoryCopy( TrackHistory *h, TrackPoint *out, int max_points ) {
+    if( h == nullptr )
+        return(0);
+
+    int n = h->count < max_points ? h->count : max_points ;
+    int start = (h->head + TRACK_HISTORY_LEN - n) % TRACK_HISTORY_LEN ;
+    for( int i = 0 ; i < n ; i++ ) {
+        out[i] = h->points[(start + i) % TRACK_HISTORY_LEN] ;
+    }
+    return( n );
+}
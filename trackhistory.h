@@ -0,0 +1,60 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef TRACKHISTORY_H
+#define TRACKHISTORY_H
+
+#include <stdint.h>
+
+#define TRACK_HISTORY_LEN 256           /* Points kept per aircraft. */
+#define TRACK_HISTORY_SLABS 1024        /* Aircraft that can hold a trail at once. */
+#define TRACK_HISTORY_MIN_INTERVAL 1000 /* Milliseconds between two stored points. */
+
+/* One point of an aircraft trail. Latitude and longitude are stored in
+ * 1e-7 degree units, time as milliseconds elapsed since the base time of
+ * the ring, so a point is 16 bytes and a full ring about 4 KiB. */
+typedef struct {
+    int32_t lat ;
+    int32_t lon ;
+    int32_t altitude ;
+    uint32_t dt ;
+} TrackPoint ;
+
+typedef struct {
+    uint64_t base ;     /* ms elapsed since epoch of the first point */
+    uint16_t head ;     /* next slot to write */
+    uint16_t count ;    /* valid points in the ring */
+    TrackPoint points[TRACK_HISTORY_LEN] ;
+} TrackHistory ;
+
+/* Fixed size slab allocator for trail rings : all the rings are allocated
+ * once, so memory stays bounded whatever the number of aircraft. When the
+ * pool is exhausted alloc() returns nullptr and the aircraft has no trail. */
+class TrackHistoryPool
+{
+public:
+    TrackHistoryPool( int slabs = TRACK_HISTORY_SLABS );
+    ~TrackHistoryPool();
+
+    TrackHistory *alloc();
+    void release( TrackHistory *h );
+    int used();
+
+private:
+    TrackHistory *slab ;
+    int *free_list ;
+    int free_count ;
+    int slab_count ;
+};
+
+void trackHistoryAppend( TrackHistory *h, double lat, double lon, int altitude, uint64_t ts );
+int trackHistoryCopy( TrackHistory *h, TrackPoint *out, int max_points );
+
+#endif // TRACKHISTORY_H
@@ -0,0 +1,100 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <stdlib.h>
+#include "updatecoalescer.h"
+
+// changes that must never wait for the end of the interval
+#define URGENT_CHANGES (ADSBUPDATE_CHANGE_SQUAWK | ADSBUPDATE_CHANGE_EMERGENCY)
+
+UpdateCoalescer::UpdateCoalescer( int interval_ms ) {
+    interval = interval_ms ;
+    next_flush = 0 ;
+}
+
+UpdateCoalescer::~UpdateCoalescer() {
+    for( auto& it : entries ) {
+        free( it.second.pending );
+    }
+    while( !ready.empty() ) {
+        free( ready.front() );
+        ready.pop();
+    }
+}
+
+void UpdateCoalescer::send( CoalescerEntry& e, ADSBUpdate *msg, uint64_t now ) {
+    if( e.pending != nullptr ) {
+        // the new state supersedes the pending one, keep its change flags
+        msg->changes |= e.pending->changes ;
+        free( e.pending );
+        e.pending = nullptr ;
+    }
+    e.last_sent = now ;
+    ready.push( msg );
+}
+
+void UpdateCoalescer::push( ADSBUpdate *msg, uint64_t now ) {
+    if( interval <= 0 ) {
+        ready.push( msg );
+        return ;
+    }
+
+    if( msg->update_type == ADSBUPDATE_TYPE_AIRCRAFTLOST ) {
+        auto it = entries.find( msg->addr );
+        if( it != entries.end() ) {
+            free( it->second.pending );
+            entries.erase( it );
+        }
+        ready.push( msg );
+        return ;
+    }
+
+    CoalescerEntry& e = entries[msg->addr] ;  // zero initialized when new
+    if( (msg->update_type == ADSBUPDATE_TYPE_NEWAIRCRAFT) ||
+        (msg->changes & URGENT_CHANGES) ||
+        (now - e.last_sent >= (uint64_t)interval) ) {
+        send( e, msg, now );
+        return ;
+    }
+
+    // merge with what is already waiting
+    if( e.pending != nullptr ) {
+        msg->changes |= e.pending->changes ;
+        free( e.pending );
+    }
+    e.pending = msg ;
+}
+
+// move to the output the pending updates whose interval has expired
+void UpdateCoalescer::flush( uint64_t now ) {
+    if( (interval <= 0) || (now < next_flush) )
+        return ;
+    // no need to scan the table more often than 10 times per interval
+    next_flush = now + (interval >= 10 ? interval/10 : 1) ;
+
+    for( auto& it : entries ) {
+        CoalescerEntry& e = it.second ;
+        if( (e.pending != nullptr) && (now - e.last_sent >= (uint64_t)interval) ) {
+            ADSBUpdate *msg = e.pending ;
+            e.pending = nullptr ;
+            send( e, msg, now );
+        }
+    }
+}
+
+bool UpdateCoalescer::hasMSG() {
+    return( !ready.empty() );
+}
+
+ADSBUpdate* UpdateCoalescer::popMSG() {
+    ADSBUpdate *msg = ready.front();
+    ready.pop();
+    return( msg );
+}
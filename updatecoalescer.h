@@ -0,0 +1,54 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef UPDATECOALESCER_H
+#define UPDATECOALESCER_H
+
+#include <stdint.h>
+#include <queue>
+#include <unordered_map>
+#include "modesdecoder.h"
+
+#define DEFAULT_UPDATE_INTERVAL 1000    /* ms between two updates of an aircraft */
+
+/* UpdateCoalescer : rate limits the updates coming out of ModeSDecoder.
+ *
+ * An aircraft is published at most once per interval. Changes received in
+ * between are merged into a single pending update (latest state, ORed
+ * change flags) sent when the interval expires. New and lost aircraft,
+ * squawk and emergency changes bypass the rate limit and go out at once.
+ * An interval of 0 passes every update through.
+ */
+class UpdateCoalescer
+{
+public:
+    UpdateCoalescer( int interval_ms = DEFAULT_UPDATE_INTERVAL );
+    ~UpdateCoalescer();
+
+    void push( ADSBUpdate *msg, uint64_t now );
+    void flush( uint64_t now );
+    bool hasMSG();
+    ADSBUpdate* popMSG();
+
+private:
+    typedef struct {
+        uint64_t last_sent ;
+        ADSBUpdate *pending ;
+    } CoalescerEntry ;
+
+    int interval ;
+    uint64_t next_flush ;
+    std::unordered_map<uint32_t, CoalescerEntry> entries ;
+    std::queue<ADSBUpdate *> ready ;
+
+    void send( CoalescerEntry& e, ADSBUpdate *msg, uint64_t now );
+};
+
+#endif // UPDATECOALESCER_H
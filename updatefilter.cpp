@@ -0,0 +1,126 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <stdlib.h>
+#include <algorithm>
+#include "updatefilter.h"
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+UpdateFilter::UpdateFilter() {
+    flags = 0 ;
+    lat_min = lat_max = 0 ;
+    lon_min = lon_max = 0 ;
+    alt_min = alt_max = 0 ;
+}
+
+// returns false, leaving the filter unchanged, if the spec is not valid
+bool UpdateFilter::compile( const char *spec ) {
+    json j = json::parse( spec, nullptr, false );
+    if( j.is_discarded() || !j.is_object() )
+        return( false );
+
+    uint32_t f = 0 ;
+    double bbox[4] = { 0, 0, 0, 0 };
+    int band[2] = { 0, 0 };
+    std::vector<uint32_t> list ;
+
+    if( j.contains("bbox") ) {
+        json& b = j["bbox"] ;
+        if( !b.is_array() || (b.size() != 4) )
+            return( false );
+        for( int i = 0 ; i < 4 ; i++ ) {
+            if( !b[i].is_number() )
+                return( false );
+            bbox[i] = b[i].get<double>() ;
+        }
+        f |= FILTER_BBOX ;
+    }
+    if( j.contains("altitude") ) {
+        json& a = j["altitude"] ;
+        if( !a.is_array() || (a.size() != 2) || !a[0].is_number() || !a[1].is_number() )
+            return( false );
+        band[0] = a[0].get<int>() ;
+        band[1] = a[1].get<int>() ;
+        f |= FILTER_ALTITUDE ;
+    }
+    if( j.contains("icao") ) {
+        json& l = j["icao"] ;
+        if( !l.is_array() )
+            return( false );
+        for( json& addr : l ) {
+            if( addr.is_number_unsigned() ) {
+                list.push_back( addr.get<uint32_t>() );
+            } else if( addr.is_string() ) {
+                std::string hex = addr.get<std::string>() ;
+                char *end ;
+                unsigned long v = strtoul( hex.c_str(), &end, 16 );
+                if( hex.empty() || (*end != 0) )
+                    return( false );
+                list.push_back( (uint32_t)v );
+            } else {
+                return( false );
+            }
+        }
+        std::sort( list.begin(), list.end() );
+        f |= FILTER_ICAO ;
+    }
+    if( j.contains("emergency") ) {
+        if( !j["emergency"].is_boolean() )
+            return( false );
+        if( j["emergency"].get<bool>() )
+            f |= FILTER_EMERGENCY ;
+    }
+
+    flags = f ;
+    lat_min = std::min( bbox[0], bbox[2] );
+    lat_max = std::max( bbox[0], bbox[2] );
+    lon_min = bbox[1] ;
+    lon_max = bbox[3] ;
+    alt_min = std::min( band[0], band[1] );
+    alt_max = std::max( band[0], band[1] );
+    icao.swap( list );
+    return( true );
+}
+
+bool UpdateFilter::match( const ADSBUpdate *msg ) const {
+    if( flags == 0 )
+        return( true );
+
+    if( (flags & FILTER_ICAO) && !std::binary_search( icao.begin(), icao.end(), msg->addr ))
+        return( false );
+    if( msg->update_type == ADSBUPDATE_TYPE_AIRCRAFTLOST )
+        return( true );
+
+    const AircraftState *ac = &msg->state ;
+    if( flags & FILTER_BBOX ) {
+        if( !ac->position_valid || (ac->lat < lat_min) || (ac->lat > lat_max) )
+            return( false );
+        if( lon_min <= lon_max ) {
+            if( (ac->lon < lon_min) || (ac->lon > lon_max) )
+                return( false );
+        } else if( (ac->lon < lon_min) && (ac->lon > lon_max) ) {
+            // box crossing the antimeridian
+            return( false );
+        }
+    }
+    if( flags & FILTER_ALTITUDE ) {
+        if( (ac->altitude == 0) || (ac->altitude < alt_min) || (ac->altitude > alt_max) )
+            return( false );
+    }
+    if( flags & FILTER_EMERGENCY ) {
+        // hijack, radio failure and emergency squawks
+        bool squawk = (ac->squawk == 7500) || (ac->squawk == 7600) || (ac->squawk == 7700) ;
+        if( (ac->emergency == 0) && !squawk )
+            return( false );
+    }
+    return( true );
+}
@@ -0,0 +1,52 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef UPDATEFILTER_H
+#define UPDATEFILTER_H
+
+#include <stdint.h>
+#include <vector>
+#include "modesdecoder.h"
+
+#define FILTER_BBOX      1
+#define FILTER_ALTITUDE  2
+#define FILTER_ICAO      4
+#define FILTER_EMERGENCY 8
+
+/* UpdateFilter : subscription filter compiled from a JSON spec like
+ *
+ *   { "bbox": [ lat_min, lon_min, lat_max, lon_max ],
+ *     "altitude": [ min_ft, max_ft ],
+ *     "icao": [ 4219421, "40621d" ],
+ *     "emergency": true }
+ *
+ * A bbox with lon_min > lon_max crosses the antimeridian. Every criterion
+ * present must match. An update without a position (or an
+ * altitude) never matches a bbox (or an altitude band). Lost aircraft
+ * updates are only checked against the ICAO list. The empty spec {}
+ * matches everything.
+ */
+class UpdateFilter
+{
+public:
+    UpdateFilter();
+
+    bool compile( const char *spec );
+    bool match( const ADSBUpdate *msg ) const ;
+
+private:
+    uint32_t flags ;
+    double lat_min, lat_max ;
+    double lon_min, lon_max ;
+    int alt_min, alt_max ;
+    std::vector<uint32_t> icao ;    /* sorted */
+};
+
+#endif // UPDATEFILTER_H
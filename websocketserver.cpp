@@ -0,0 +1,415 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include "websocketserver.h"
+#include "jsonwriter.h"
+
+#define WS_HEADER_MAXLEN 10
+#define WS_MESSAGE_HEADER 128               /* "now", "type" and the brackets */
+#define WS_LOST_MAXLEN 12                   /* "xxxxxx", */
+
+#define WS_OPCODE_TEXT 0x1
+#define WS_OPCODE_CLOSE 0x8
+#define WS_OPCODE_PING 0x9
+#define WS_OPCODE_PONG 0xa
+
+static const char WS_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11" ;
+
+static uint32_t rol( uint32_t x, int n ) {
+    return( (x << n) | (x >> (32 - n)) );
+}
+
+// SHA-1 of a short text, only used for Sec-WebSocket-Accept
+static void sha1( const uint8_t *data, size_t len, uint8_t digest[20] ) {
+    uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+    size_t total = ((len + 8) / 64 + 1) * 64 ;
+    uint8_t *msg = (uint8_t *)calloc( total, 1 );
+    memcpy( msg, data, len );
+    msg[len] = 0x80 ;
+    uint64_t bits = (uint64_t)len * 8 ;
+    for( int i = 0 ; i < 8 ; i++ ) {
+        msg[total - 1 - i] = (uint8_t)(bits >> (8 * i));
+    }
+
+    for( size_t block = 0 ; block < total ; block += 64 ) {
+        uint32_t w[80] ;
+        for( int i = 0 ; i < 16 ; i++ ) {
+            const uint8_t *p = msg + block + 4 * i ;
+            w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3] ;
+        }
+        for( int i = 16 ; i < 80 ; i++ ) {
+            w[i] = rol( w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1 );
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4] ;
+        for( int i = 0 ; i < 80 ; i++ ) {
+            uint32_t f, k ;
+            if( i < 20 ) {
+                f = (b & c) | (~b & d) ;
+                k = 0x5a827999 ;
+            } else if( i < 40 ) {
+                f = b ^ c ^ d ;
+                k = 0x6ed9eba1 ;
+            } else if( i < 60 ) {
+                f = (b & c) | (b & d) | (c & d) ;
+                k = 0x8f1bbcdc ;
+            } else {
+                f = b ^ c ^ d ;
+                k = 0xca62c1d6 ;
+            }
+            uint32_t t = rol( a, 5 ) + f + e + k + w[i] ;
+            e = d ;
+            d = c ;
+            c = rol( b, 30 );
+            b = a ;
+            a = t ;
+        }
+        h[0] += a ; h[1] += b ; h[2] += c ; h[3] += d ; h[4] += e ;
+    }
+    free( msg );
+
+    for( int i = 0 ; i < 20 ; i++ ) {
+        digest[i] = (uint8_t)(h[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
+
+static size_t base64( const uint8_t *data, size_t len, char *out ) {
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/" ;
+    char *p = out ;
+    for( size_t i = 0 ; i < len ; i += 3 ) {
+        uint32_t v = (uint32_t)data[i] << 16 ;
+        if( i + 1 < len ) v |= (uint32_t)data[i+1] << 8 ;
+        if( i + 2 < len ) v |= data[i+2] ;
+        *p++ = alphabet[(v >> 18) & 63] ;
+        *p++ = alphabet[(v >> 12) & 63] ;
+        *p++ = i + 1 < len ? alphabet[(v >> 6) & 63] : '=' ;
+        *p++ = i + 2 < len ? alphabet[v & 63] : '=' ;
+    }
+    *p = 0 ;
+    return( p - out );
+}
+
+// writes the frame header just before the payload, returns its start
+static uint8_t *frameHeader( uint8_t *payload, size_t len, int opcode ) {
+    uint8_t *h ;
+    if( len < 126 ) {
+        h = payload - 2 ;
+        h[1] = (uint8_t)len ;
+    } else if( len < 65536 ) {
+        h = payload - 4 ;
+        h[1] = 126 ;
+        h[2] = (uint8_t)(len >> 8) ;
+        h[3] = (uint8_t)len ;
+    } else {
+        h = payload - 10 ;
+        h[1] = 127 ;
+        for( int i = 0 ; i < 8 ; i++ ) {
+            h[9 - i] = (uint8_t)(len >> (8 * i));
+        }
+    }
+    h[0] = 0x80 | opcode ;  // FIN, server frames are never masked
+    return( h );
+}
+
+WebSocketServer::WebSocketServer( AircraftSnapshot *snapshot ) : TCPFeedServer( WEBSOCKET_MAX_CLIENTS ) {
+    this->snapshot = snapshot ;
+    tick_interval = DEFAULT_WEBSOCKET_TICK ;
+    last_tick = 0 ;
+    table = (AircraftState *)malloc( snapshot->capacity() * sizeof(AircraftState));
+}
+
+WebSocketServer::~WebSocketServer() {
+    stop();
+    free( table );
+}
+
+bool WebSocketServer::start( int port, int tick_ms ) {
+    if( tick_ms <= 0 )
+        return( false );
+    tick_interval = tick_ms ;
+    return( TCPFeedServer::start( port ));
+}
+
+// producer side : merge the changes of one update, the caller keeps it
+void WebSocketServer::push( const ADSBUpdate *msg ) {
+    if( !isRunning() )
+        return ;
+    if( msg->update_type == ADSBUPDATE_TYPE_AIRCRAFTLOST ) {
+        // sent even when it came and went within the tick, clients ignore
+        // the aircraft they do not know
+        pending.erase( msg->addr );
+        if( std::find( lost.begin(), lost.end(), msg->addr ) == lost.end() )
+            lost.push_back( msg->addr );
+        return ;
+    }
+    WSDelta& d = pending[msg->addr] ;
+    if( msg->update_type == ADSBUPDATE_TYPE_NEWAIRCRAFT ) {
+        // lost and found again within the tick : only the new one is sent
+        std::vector<uint32_t>::iterator it = std::find( lost.begin(), lost.end(), msg->addr );
+        if( it != lost.end() )
+            lost.erase( it );
+        d.added = true ;
+    }
+    d.changes |= msg->changes ;
+    d.state = msg->state ;
+}
+
+// producer side : once per block, sends the delta when a tick is due
+void WebSocketServer::tick( uint64_t now ) {
+    if( !isRunning() ) {
+        pending.clear();
+        lost.clear();
+        return ;
+    }
+    if( now - last_tick < (uint64_t)tick_interval.load() )
+        return ;
+    last_tick = now ;
+    if( pending.empty() && lost.empty() )
+        return ;
+
+    size_t size = WS_HEADER_MAXLEN + WS_MESSAGE_HEADER +
+            pending.size() * AIRCRAFT_JSON_MAXLEN + lost.size() * WS_LOST_MAXLEN ;
+    if( delta_buffer.size() < size )
+        delta_buffer.resize( size );
+    char *payload = delta_buffer.data() + WS_HEADER_MAXLEN ;
+    JSONWriter w( payload, size - WS_HEADER_MAXLEN );
+
+    w.beginObject();
+    w.key("aircraft");
+    w.beginArray();
+    for( std::pair<const uint32_t, WSDelta>& e : pending ) {
+        const WSDelta& d = e.second ;
+        const AircraftState *ac = &d.state ;
+        if( d.added ) {
+            writeAircraftState( w, ac, now );
+            continue ;
+        }
+        char hex[8] ;
+        snprintf( hex, sizeof(hex), "%06x", ac->addr & 0xffffff );
+        w.beginObject();
+        if( d.changes & ADSBUPDATE_CHANGE_ALTITUDE ) {
+            w.key("altitude");       w.value( ac->altitude );
+        }
+        if( d.changes & ADSBUPDATE_CHANGE_EMERGENCY ) {
+            w.key("emergency");      w.value( ac->emergency );
+        }
+        if( d.changes & ADSBUPDATE_CHANGE_FLIGHT ) {
+            w.key("flight");         w.value( ac->flight );
+        }
+        w.key("hex");                w.value( hex );
+        w.key("icao");               w.value( ac->addr );
+        if( (d.changes & ADSBUPDATE_CHANGE_POSITION) && ac->position_valid ) {
+            w.key("lat");            w.value( ac->lat );
+            w.key("lon");            w.value( ac->lon );
+        }
+        if( d.changes & ADSBUPDATE_CHANGE_VELOCITY ) {
+            w.key("speed");          w.value( ac->speed );
+        }
+        if( d.changes & ADSBUPDATE_CHANGE_SQUAWK ) {
+            w.key("squawk");         w.value( ac->squawk );
+        }
+        if( d.changes & ADSBUPDATE_CHANGE_VELOCITY ) {
+            w.key("track");          w.value( ac->track );
+            w.key("vert_rate");      w.value( ac->vert_rate );
+            w.key("vert_rate_sign"); w.value( ac->vert_rate_sign );
+        }
+        w.endObject();
+    }
+    w.endArray();
+    if( !lost.empty() ) {
+        w.key("lost");
+        w.beginArray();
+        for( uint32_t addr : lost ) {
+            char hex[8] ;
+            snprintf( hex, sizeof(hex), "%06x", addr & 0xffffff );
+            w.value( hex );
+        }
+        w.endArray();
+    }
+    w.key("now");   w.value( now );
+    w.key("type");  w.value( "delta" );
+    w.endObject();
+
+    pending.clear();
+    lost.clear();
+    if( w.overflow() )
+        return ;
+
+    // encoded once, the same chunk goes to every client
+    uint8_t *frame = frameHeader( (uint8_t *)payload, w.length(), WS_OPCODE_TEXT );
+    write( frame, (uint8_t *)payload + w.length() - frame );
+    publish();
+}
+
+void WebSocketServer::clientConnected( FeedClient *c ) {
+    // no broadcast until the handshake is done
+    c->ready = false ;
+    c->ctx = new WSClient ;
+}
+
+void WebSocketServer::clientClosed( FeedClient *c ) {
+    delete (WSClient *)c->ctx ;
+    c->ctx = nullptr ;
+}
+
+void WebSocketServer::clientData( FeedClient *c, const uint8_t *data, size_t len ) {
+    WSClient *ws = (WSClient *)c->ctx ;
+    if( !c->ready ) {
+        ws->request.append( (const char *)data, len );
+        size_t end = ws->request.find( "\r\n\r\n" );
+        if( end == std::string::npos ) {
+            if( ws->request.size() > WEBSOCKET_MAX_REQUEST )
+                closeClient( c );
+            return ;
+        }
+        // frames may follow the request in the same read
+        ws->in.assign( ws->request.begin() + end + 4, ws->request.end() );
+        ws->request.resize( end + 2 );
+        if( !handshake( c, ws ))
+            return ;
+    } else {
+        ws->in.insert( ws->in.end(), data, data + len );
+    }
+    readFrames( c, ws );
+}
+
+// answers the HTTP upgrade request, then sends the current aircraft table
+bool WebSocketServer::handshake( FeedClient *c, WSClient *ws ) {
+    const char *key = nullptr ;
+    size_t key_len = 0 ;
+    bool get = strncmp( ws->request.c_str(), "GET ", 4 ) == 0 ;
+    size_t pos = ws->request.find( "\r\n" );
+    while( get && (pos != std::string::npos) ) {
+        const char *line = ws->request.c_str() + pos + 2 ;
+        size_t next = ws->request.find( "\r\n", pos + 2 );
+        if( strncasecmp( line, "Sec-WebSocket-Key:", 18 ) == 0 ) {
+            key = line + 18 ;
+            while( *key == ' ' ) key++ ;
+            key_len = ws->request.c_str() + next - key ;
+            while( (key_len > 0) && (key[key_len-1] == ' ') ) key_len-- ;
+            break ;
+        }
+        pos = next ;
+    }
+    if( (key == nullptr) || (key_len == 0) || (key_len > 64) ) {
+        const char reply[] = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n" ;
+        sendTo( c, reply, sizeof(reply) - 1 );
+        closeClient( c );
+        return( false );
+    }
+
+    uint8_t accept_key[128] ;
+    uint8_t digest[20] ;
+    char accept[32] ;
+    memcpy( accept_key, key, key_len );
+    memcpy( accept_key + key_len, WS_GUID, sizeof(WS_GUID) - 1 );
+    sha1( accept_key, key_len + sizeof(WS_GUID) - 1, digest );
+    base64( digest, sizeof(digest), accept );
+
+    char reply[256] ;
+    int n = snprintf( reply, sizeof(reply),
+                      "HTTP/1.1 101 Switching Protocols\r\n"
+                      "Upgrade: websocket\r\n"
+                      "Connection: Upgrade\r\n"
+                      "Sec-WebSocket-Accept: %s\r\n\r\n", accept );
+    std::string().swap( ws->request );
+    sendTo( c, reply, n );
+
+    sendSnapshot( c );
+    if( c->fd < 0 )
+        return( false );
+    c->ready = true ;
+    return( true );
+}
+
+void WebSocketServer::sendSnapshot( FeedClient *c ) {
+    uint64_t time ;
+    int count = snapshot->read( table, snapshot->capacity(), &time );
+    size_t size = WS_HEADER_MAXLEN + WS_MESSAGE_HEADER + count * AIRCRAFT_JSON_MAXLEN ;
+    if( snapshot_buffer.size() < size )
+        snapshot_buffer.resize( size );
+    char *payload = snapshot_buffer.data() + WS_HEADER_MAXLEN ;
+    JSONWriter w( payload, size - WS_HEADER_MAXLEN );
+
+    w.beginObject();
+    w.key("aircraft");
+    w.beginArray();
+    for( int i = 0 ; i < count ; i++ ) {
+        writeAircraftState( w, &table[i], time );
+    }
+    w.endArray();
+    w.key("now");   w.value( time );
+    w.key("type");  w.value( "snapshot" );
+    w.endObject();
+    if( w.overflow() )
+        return ;
+
+    uint8_t *frame = frameHeader( (uint8_t *)payload, w.length(), WS_OPCODE_TEXT );
+    sendTo( c, frame, (uint8_t *)payload + w.length() - frame );
+}
+
+// client frames : answers ping and close, ignores the rest
+void WebSocketServer::readFrames( FeedClient *c, WSClient *ws ) {
+    size_t pos = 0 ;
+    while( c->fd >= 0 ) {
+        const uint8_t *p = ws->in.data() + pos ;
+        size_t avail = ws->in.size() - pos ;
+        if( avail < 2 )
+            break ;
+        int opcode = p[0] & 0x0f ;
+        bool masked = (p[1] & 0x80) != 0 ;
+        uint64_t len = p[1] & 0x7f ;
+        size_t header = 2 ;
+        if( len == 126 ) {
+            if( avail < 4 ) break ;
+            len = ((uint64_t)p[2] << 8) | p[3] ;
+            header = 4 ;
+        } else if( len == 127 ) {
+            if( avail < 10 ) break ;
+            len = 0 ;
+            for( int i = 0 ; i < 8 ; i++ ) {
+                len = (len << 8) | p[2 + i] ;
+            }
+            header = 10 ;
+        }
+        if( !masked || (len > WEBSOCKET_MAX_MESSAGE) ) {
+            // clients must mask, and have nothing big to say
+            closeClient( c );
+            return ;
+        }
+        if( avail < header + 4 + len )
+            break ;
+
+        uint8_t frame[WS_HEADER_MAXLEN + WEBSOCKET_MAX_MESSAGE] ;
+        uint8_t *payload = frame + WS_HEADER_MAXLEN ;
+        const uint8_t *mask = p + header ;
+        for( size_t i = 0 ; i < len ; i++ ) {
+            payload[i] = p[header + 4 + i] ^ mask[i & 3] ;
+        }
+        pos += header + 4 + len ;
+
+        if( opcode == WS_OPCODE_PING ) {
+            uint8_t *h = frameHeader( payload, len, WS_OPCODE_PONG );
+            sendTo( c, h, payload + len - h );
+        } else if( opcode == WS_OPCODE_CLOSE ) {
+            uint8_t *h = frameHeader( payload, len, WS_OPCODE_CLOSE );
+            sendTo( c, h, payload + len - h );
+            closeClient( c );
+            return ;
+        }
+    }
+    if( c->fd >= 0 )
+        ws->in.erase( ws->in.begin(), ws->in.begin() + pos );
+}
@@ -0,0 +1,98 @@
+/****************************************************************
+ *                                                              *
+ * @copyright  Copyright (c) 2020 SDR-Technologies SAS          *
+ * @author     Sylvain AZARIAN - s.azarian@sdr-technologies.fr  *
+ * @project    SDR Virtual Machine                              *
+ *                                                              *
+ * Code propriete exclusive de la société SDR-Technologies SAS  *
+ *                                                              *
+ ****************************************************************/
+
+#ifndef WEBSOCKETSERVER_H
+#define WEBSOCKETSERVER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "feedserver.h"
+#include "aircraftsnapshot.h"
+
+#define DEFAULT_WEBSOCKET_PORT 8080
+#define DEFAULT_WEBSOCKET_TICK 1000         /* ms between two delta messages */
+#define WEBSOCKET_MAX_CLIENTS 1024
+#define WEBSOCKET_MAX_REQUEST 8192          /* HTTP upgrade request */
+#define WEBSOCKET_MAX_MESSAGE 4096          /* client to server frames */
+
+/* WebSocketServer : live aircraft feed for browser maps.
+ *
+ * A client connecting to ws://host:port/ first gets the whole aircraft
+ * table, taken from the decoder snapshot :
+ *
+ *   {"aircraft":[{...},...],"now":1631385923042,"type":"snapshot"}
+ *
+ * with the same aircraft objects as getAircraft(). Then once per tick, only
+ * what changed since the previous tick :
+ *
+ *   {"aircraft":[{"altitude":38000,"hex":"40621d","icao":4219421},...],
+ *    "lost":["3c4b26"],"now":1631385924042,"type":"delta"}
+ *
+ * A new aircraft comes with all its fields, a known one with "hex", "icao"
+ * and the fields of the changed groups only (altitude ; lat, lon ; speed,
+ * track, vert_rate, vert_rate_sign ; flight ; squawk ; emergency).
+ *
+ * The producer (decode_thread) gives every decoder update to push(), which
+ * merges the changes per aircraft, and calls tick() once per block. The
+ * delta is encoded once as a WebSocket text frame and the same bytes are
+ * shared by all the clients, the server thread only deals with the
+ * handshakes, the snapshots and the control frames.
+ */
+class WebSocketServer : public TCPFeedServer
+{
+public:
+    WebSocketServer( AircraftSnapshot *snapshot );
+    ~WebSocketServer();
+
+    bool start( int port, int tick_ms = DEFAULT_WEBSOCKET_TICK );
+
+    // producer side
+    void push( const ADSBUpdate *msg );
+    void tick( uint64_t now );
+
+protected:
+    void clientConnected( FeedClient *c );
+    void clientData( FeedClient *c, const uint8_t *data, size_t len );
+    void clientClosed( FeedClient *c );
+
+private:
+    typedef struct {
+        std::string request ;           /* HTTP request until the handshake is done */
+        std::vector<uint8_t> in ;       /* incomplete client frame */
+    } WSClient ;
+
+    typedef struct {
+        bool added ;
+        uint16_t changes ;
+        AircraftState state ;
+    } WSDelta ;
+
+    AircraftSnapshot *snapshot ;
+    std::atomic<int> tick_interval ;
+
+    // producer side
+    std::unordered_map<uint32_t, WSDelta> pending ;
+    std::vector<uint32_t> lost ;
+    uint64_t last_tick ;
+    std::vector<char> delta_buffer ;
+
+    // server thread side
+    AircraftState *table ;
+    std::vector<char> snapshot_buffer ;
+
+    bool handshake( FeedClient *c, WSClient *ws );
+    void sendSnapshot( FeedClient *c );
+    void readFrames( FeedClient *c, WSClient *ws );
+};
+
+#endif // WEBSOCKETSERVER_H